@@ -55,6 +55,28 @@ _CWIPC_ORBBEC_EXPORT cwipc_activesource* cwipc_orbbec(const char *configFilename
 
 _CWIPC_ORBBEC_EXPORT cwipc_activesource* cwipc_orbbec_playback(const char* configFilename, char** errorMessage, uint64_t apiVersion);
 
+/** \brief Function called with every merged point cloud, see cwipc_orbbec_set_pointcloud_callback().
+ * \param pc The point cloud. The callback owns it, and must eventually free() it.
+ * \param user_data The user_data passed to cwipc_orbbec_set_pointcloud_callback().
+ */
+typedef void (*cwipc_orbbec_pointcloud_callback)(cwipc_pointcloud* pc, void* user_data);
+
+/** \brief Have an Orbbec capturer push point clouds to a callback.
+ * \param src A cwipc_activesource returned by cwipc_orbbec() or cwipc_orbbec_playback().
+ * \param callback Function to call, or NULL to go back to get().
+ * \param user_data Passed to callback.
+ * \return false if src is not an Orbbec capturer, or if called from the callback.
+ *
+ * The capturer calls callback from its capture thread as soon as a merged point cloud is ready,
+ * and keeps capturing at camera rate without waiting for get() calls. While a callback is
+ * registered get() returns NULL and available() returns false (threads waiting in them return
+ * immediately), and point clouds merged before registering are discarded. The callback should return quickly.
+ * It runs on a capture thread, so it must not call cwipc_orbbec_set_pointcloud_callback(), stop() or
+ * free() on src: those wait for the capture threads to finish, which would deadlock (stop() and
+ * cwipc_orbbec_set_pointcloud_callback() refuse and log an error). When cwipc_orbbec_set_pointcloud_callback()
+ * returns the previous callback is no longer running and will not be called again.
+ */
+_CWIPC_ORBBEC_EXPORT bool cwipc_orbbec_set_pointcloud_callback(cwipc_activesource* src, cwipc_orbbec_pointcloud_callback callback, void* user_data);
 
 #ifdef __cplusplus
 }
@@ -2,20 +2,27 @@ import os
 import ctypes
 import ctypes.util
 import warnings
-from typing import Optional
+import traceback
+from typing import Optional, Callable, Any
 from cwipc.util import CwipcError, CWIPC_API_VERSION, cwipc_activesource_wrapper
-from cwipc.util import cwipc_activesource_p
+from cwipc.util import cwipc_activesource_p, cwipc_pointcloud_p, cwipc_pointcloud_wrapper
 from cwipc.util import _cwipc_dll_search_path_collection # type: ignore
 
 __all__ = [
     "cwipc_get_version_module",
     "cwipc_orbbec",
     "cwipc_orbbec_playback",
+    "cwipc_orbbec_set_pointcloud_callback",
     "cwipc_orbbec_dll_load"
 ]
 
 _cwipc_orbbec_dll_reference = None
 
+cwipc_orbbec_pointcloud_callback_t = ctypes.CFUNCTYPE(None, cwipc_pointcloud_p, ctypes.c_void_p)
+
+# The C library holds on to the callback function pointers, so we must keep the ctypes objects alive.
+_cwipc_orbbec_callback_references : dict[int, Any] = {}
+
 #
 # NOTE: the signatures here must match those in cwipc_util/api.h or all hell will break loose
 #
@@ -48,6 +55,9 @@ def cwipc_orbbec_dll_load(libname : Optional[str]=None) -> ctypes.CDLL:
     
     _cwipc_orbbec_dll_reference.cwipc_orbbec_playback.argtypes = [ctypes.c_char_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_ulong]
     _cwipc_orbbec_dll_reference.cwipc_orbbec_playback.restype = cwipc_activesource_p
+
+    _cwipc_orbbec_dll_reference.cwipc_orbbec_set_pointcloud_callback.argtypes = [cwipc_activesource_p, cwipc_orbbec_pointcloud_callback_t, ctypes.c_void_p]
+    _cwipc_orbbec_dll_reference.cwipc_orbbec_set_pointcloud_callback.restype = ctypes.c_bool
     return _cwipc_orbbec_dll_reference
 
 
@@ -84,4 +94,35 @@ def cwipc_orbbec_playback(conffile : Optional[str]=None) -> cwipc_activesource_w
         warnings.warn(errorString.value.decode('utf8'))
     if rv:
         return cwipc_activesource_wrapper(rv)
-    raise CwipcError("cwipc_orbbecplayback: no cwipc_activesource created, but no specific error returned from C library")
\ No newline at end of file
+    raise CwipcError("cwipc_orbbecplayback: no cwipc_activesource created, but no specific error returned from C library")
+
+
+def cwipc_orbbec_set_pointcloud_callback(source : cwipc_activesource_wrapper, callback : Optional[Callable[[cwipc_pointcloud_wrapper], None]]) -> None:
+    """Have an orbbec source push every point cloud to callback (on a capture thread) in stead of returning it from get().
+    
+    Pass None to go back to get(). The callback owns the point cloud and should free() it.
+    While a callback is registered get() returns None. If the callback raises the point cloud is freed.
+    The callback must not call stop() or free() on source, or this function.
+    """
+    source_p = source._as_cwipc_activesource_p()
+    key = ctypes.cast(source_p, ctypes.c_void_p).value or 0
+    if callback is None:
+        c_callback = ctypes.cast(None, cwipc_orbbec_pointcloud_callback_t)
+    else:
+        def _c_callback(pc : cwipc_pointcloud_p, user_data : ctypes.c_void_p) -> None:
+            wrapper = cwipc_pointcloud_wrapper(pc)
+            try:
+                callback(wrapper)
+            except Exception:
+                # An exception cannot propagate into the capture thread, and the callback never got to free the point cloud.
+                wrapper.free()
+                traceback.print_exc()
+        c_callback = cwipc_orbbec_pointcloud_callback_t(_c_callback)
+    ok = cwipc_orbbec_dll_load().cwipc_orbbec_set_pointcloud_callback(source_p, c_callback, None)
+    if not ok:
+        raise CwipcError("cwipc_orbbec_set_pointcloud_callback: not an orbbec source, or called from the callback")
+    # Only drop the old reference after the C library has promised not to call it any more.
+    if callback is None:
+        _cwipc_orbbec_callback_references.pop(key, None)
+    else:
+        _cwipc_orbbec_callback_references[key] = c_callback
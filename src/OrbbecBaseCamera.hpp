@@ -1,8 +1,14 @@
 #pragma once
 
 #include <string>
+#include <algorithm>
+#include <cmath>
 #include <mutex>
+#include <deque>
 #include <condition_variable>
+#include <atomic>
+#include <opencv2/core.hpp>
+#include <opencv2/imgproc.hpp>
 
 #include "libobsensor/h/ObTypes.h"
 #include "libobsensor/hpp/Frame.hpp"
@@ -12,6 +18,16 @@
 
 #include "cwipc_util/internal/capturers.hpp"
 #include "OrbbecConfig.hpp"
+#include "OrbbecColorMapper.hpp"
+#include "OrbbecDecimation.hpp"
+#include "OrbbecDeprojector.hpp"
+#include "OrbbecGreenscreen.hpp"
+#include "OrbbecNormals.hpp"
+#include "OrbbecPointKernels.hpp"
+#include "OrbbecTileCache.hpp"
+#include "OrbbecVoxelGrid.hpp"
+#include "OrbbecWorkerPool.hpp"
+
 template<typename Type_api_camera> 
 class OrbbecBaseCamera : public CwipcBaseCamera {
 
@@ -23,7 +39,6 @@ public:
         configuration(_configuration),
         serial(_configuration.all_camera_configs[_camera_index].serial),
         camera_sync_ismaster(serial == configuration.sync.sync_master_serial),
-        camera_stopped(true),
         camera_config(_configuration.all_camera_configs[_camera_index]),
         filtering(_configuration.filtering),
         processing(_configuration.processing),
@@ -31,11 +46,13 @@ public:
         metadata(_metadata),
         camera_device(_handle),
         captured_frame_queue(1),
-        processing_frame_queue(1),
         camera_sync_inuse(configuration.sync.sync_master_serial != ""),
         current_captured_frameset(nullptr),
         debug(_configuration.debug)    
     {
+        background_request = processing.background_frames > 0 ? processing.background_frames : -1;
+        point_kernels = &orbbec_select_point_kernels();
+        if (debug) _log_debug(std::string("using point kernels ") + point_kernels->name);
     }
 
     virtual ~OrbbecBaseCamera() {
@@ -45,6 +62,9 @@ public:
 
     /// Step 1 in starting: tell the camera we are going to start. Called for all cameras.
     virtual bool pre_start_all_cameras() final { 
+        if (!_init_processing_queue()) {
+            return false;
+        }
         if (!_init_filters()) {
             return false;
         }
@@ -68,27 +88,25 @@ public:
     virtual void stop_camera() final {
         if (debug) _log_debug("stop camera");
         camera_stopped = true;
-        // clear out processing_frame_queue...
-        while(true) {
-            std::shared_ptr<ob::FrameSet> dummy;
-            if (!processing_frame_queue.try_dequeue(dummy)) break;
+        // clear out the processing queue, wake up a blocked process_pointcloud_from_frameset,
+        // and wait for a processing task that is still running.
+        {
+            std::unique_lock<std::mutex> lock(processing_queue_mutex);
+            processing_queue.clear();
+            processing_queue_cv.notify_all();
+            processing_queue_cv.wait(lock, [this] { return !processing_task_active; });
         }
-        // push nullptr to ensure wakeup of processing_thread
-        processing_frame_queue.try_enqueue(nullptr);
-        // join it.
-        if (camera_processing_thread) {
-            camera_processing_thread->join();
-        }
-        delete camera_processing_thread;
-        camera_processing_thread = nullptr;
 
         if (camera_started && camera_pipeline != nullptr) {
             camera_pipeline->stop();
             camera_pipeline = nullptr;
             camera_started = false;
         }
-        processing_done = true;
-        processing_done_cv.notify_one();
+        {
+            std::lock_guard<std::mutex> lock(processing_mutex);
+            processed_frames.clear();
+        }
+        processing_done_cv.notify_all();
         if (debug) _log_debug("camera stopped");
     }
 
@@ -104,11 +122,17 @@ public:
     }
 
     virtual bool map2d3d(int x_2d, int y_2d, int d_2d, float* out3d) override final {
-        if (current_processed_frameset == nullptr) {
+        // We are called from API threads while the capture threads may replace current_processed_frameset.
+        std::shared_ptr<ob::FrameSet> frameset;
+        {
+            std::lock_guard<std::mutex> lock(processing_mutex);
+            frameset = current_processed_frameset;
+        }
+        if (frameset == nullptr) {
             _log_error("map2d3d: current_processed_frameset is NULL");
             return false;
         }
-        std::shared_ptr<ob::Frame> depth_frame = current_processed_frameset->getFrame(OB_FRAME_DEPTH);
+        std::shared_ptr<ob::Frame> depth_frame = frameset->getFrame(OB_FRAME_DEPTH);
         if (depth_frame == nullptr) {
             _log_error("map2d3d: missing depth frame");
             return false;
@@ -134,16 +158,8 @@ public:
             _log_error(std::string("map2d3d: ob_error: ")+ob_error_get_message(error));
             return false;
         }
-        cwipc_pcl_point pt = {
-            (float)(result.x/1000.0),
-            (float)(result.y/1000.0),
-            (float)(result.z/1000.0),
-            0, 0, 0, 0};
-        _log_debug("map2d3d: result x="+std::to_string(pt.x) + ",y="+std::to_string(pt.y)+",z="+std::to_string(pt.z));
-        _transform_point_cam_to_world(pt);
-        out3d[0] = pt.x;
-        out3d[1] = pt.y;
-        out3d[2] = pt.z;
+        _log_debug("map2d3d: result x="+std::to_string(result.x) + ",y="+std::to_string(result.y)+",z="+std::to_string(result.z));
+        _transform_point_cam_to_world(result.x, result.y, result.z, out3d);
         return true;
     }
 
@@ -186,26 +202,95 @@ public:
         return resultant_timestamp;
     }
     /// Step 2: Forward the current_captured_frameset to the processing thread to turn it into a point cloud.
-    virtual void process_pointcloud_from_frameset() final {
+    /// sequence identifies the frame: the capturer passes the same number to all cameras, and increments it for every frame.
+    /// If the processing queue is full the processing_queue_policy decides what happens. A dropped frame
+    /// results in an empty point cloud for its sequence number, and is counted in get_dropped_frame_count().
+    virtual void process_pointcloud_from_frameset(uint64_t sequence) final {
         assert(current_captured_frameset && current_captured_frameset.getImpl());
-
-        if (!processing_frame_queue.try_enqueue(current_captured_frameset)) {
-            _log_warning("processing_frame_queue full, dropping frame");
-            // Orbbec releases the current_captured_frameset automatically.
+        std::unique_lock<std::mutex> lock(processing_queue_mutex);
+        if ((int)processing_queue.size() >= processing_queue_size) {
+            if (processing_queue_policy == ORBBEC_QUEUE_BLOCK) {
+                processing_queue_cv.wait(lock, [this] { return (int)processing_queue.size() < processing_queue_size || camera_stopped; });
+            } else if (processing_queue_policy == ORBBEC_QUEUE_DROP_OLDEST) {
+                _drop_frame(processing_queue.front().sequence);
+                processing_queue.pop_front();
+            } else {
+                _drop_frame(sequence);
+                // Orbbec releases the current_captured_frameset automatically.
+                current_captured_frameset = nullptr;
+                return;
+            }
         }
+        bool start_task = false;
+        if (!camera_stopped) {
+            processing_queue.push_back({sequence, current_captured_frameset});
+            // Framesets of one camera are processed one at a time, in order, by a task on the shared worker pool.
+            start_task = !processing_task_active;
+            processing_task_active = true;
+        }
+        lock.unlock();
         current_captured_frameset = nullptr;
+        if (start_task) {
+            OrbbecWorkerPool::instance().submit([this] { _process_queued_framesets(); });
+        }
     }
-    /// Step 3: Wait for the point cloud processing.
+    /// Step 3: Wait for the point cloud of frame sequence (as passed to process_pointcloud_from_frameset()).
     /// After this, current_pcl_pointcloud and current_processed_frameset will be valid.
-    virtual void wait_for_pointcloud_processed() final {
+    /// Returns false (and leaves them alone) if the camera was stopped before the point cloud was ready.
+    virtual bool wait_for_pointcloud_processed(uint64_t sequence) final {
         std::unique_lock<std::mutex> lock(processing_mutex);
-        processing_done_cv.wait(lock, [this] { return processing_done; });
-        processing_done = false;
+        while (true) {
+            // Results of earlier frames nobody waited for are stale.
+            while (!processed_frames.empty() && processed_frames.front().sequence < sequence) {
+                processed_frames.pop_front();
+            }
+            if (!processed_frames.empty() && processed_frames.front().sequence == sequence) break;
+            if (camera_stopped) return false;
+            processing_done_cv.wait(lock);
+        }
+        ProcessedFrame& frame = processed_frames.front();
+        current_pcl_pointcloud = frame.pointcloud;
+        current_normals.swap(frame.normals);
+        current_processed_frameset = frame.frameset;
+        processed_frames.pop_front();
+        return true;
     }
     /// Step 4: borrow a pointer to the point cloud just created, as a PCL point cloud.
     /// The capturer will use this to populate the resultant cwipc point cloud with points
     /// from all cameras.
-    cwipc_pcl_pointcloud access_current_pcl_pointcloud() { return current_pcl_pointcloud; }
+    cwipc_pcl_pointcloud access_current_pcl_pointcloud() {
+        std::lock_guard<std::mutex> lock(processing_mutex);
+        return current_pcl_pointcloud;
+    }
+    /// World-space normals (3 floats per point) of the point cloud just created, if normals metadata
+    /// was requested. Otherwise (or if the point cloud was not generated) the size will not match.
+    const std::vector<float>& access_current_normals() { return current_normals; }
+    /// Number of frames dropped because the processing queue was full, since the camera was created.
+    uint64_t get_dropped_frame_count() {
+        return dropped_frame_count;
+    }
+    /// Learn the background (the static scene) from the next nframes depth images. nframes == 0 forgets
+    /// the background, nframes < 0 uses processing.background_frames (or BACKGROUND_FRAMES_DEFAULT if that is 0).
+    /// Can be called from any thread: the processing thread picks up the request.
+    /// At most BACKGROUND_FRAMES_MAX frames are used.
+    void learn_background(int nframes) {
+        if (nframes < 0) {
+            nframes = processing.background_frames > 0 ? processing.background_frames : BACKGROUND_FRAMES_DEFAULT;
+        }
+        if (nframes > BACKGROUND_FRAMES_MAX) {
+            _log_warning("learn_background: using " + std::to_string(BACKGROUND_FRAMES_MAX) + " frames in stead of " + std::to_string(nframes));
+            nframes = BACKGROUND_FRAMES_MAX;
+        }
+        background_request = nframes;
+    }
+
+    /// Position of this camera in world coordinates (meters). Used when merging to decide which camera has the best view of a point.
+    void get_world_position(float* out3d) {
+        Eigen::Vector3d position = camera_config.trafo->translation();
+        out3d[0] = (float)position.x();
+        out3d[1] = (float)position.y();
+        out3d[2] = (float)position.z();
+    }
     /// Step 5: Save metadata from frameset into given cwipc object.
     void save_frameset_metadata(cwipc_pointcloud *pc) {
         auto current_frameset = current_captured_frameset;
@@ -285,9 +370,36 @@ protected:
     // internal API that is "shared" with other implementations (realsense, kinect)
     /// Initialize any hardware settings for this camera.
     virtual bool _init_hardware_for_this_camera() override = 0;
-    /// Initialize any filters that will be applied to all RGB/D images.
+    /// Check the processing settings and set up our own filters (we do not use the Orbbec SDK filters):
+    /// validate the decimation, background and incremental settings, build the erosion kernels and
+    /// build the greenscreen table. Returns false if a setting is invalid.
     virtual bool _init_filters() override final {
-        // Orbbec API does not provide any filtering that needs to be initialized.
+        if (processing.decimation < 1 || processing.decimation > ORBBEC_DECIMATION_MAX) {
+            _log_error("processing.decimation must be between 1 and " + std::to_string(ORBBEC_DECIMATION_MAX));
+            return false;
+        }
+        if (!orbbec_decimation_mode_from_string(processing.decimation_mode, decimation_mode)) {
+            _log_error("unknown processing.decimation_mode " + processing.decimation_mode);
+            return false;
+        }
+        if (processing.depth_x_erosion > 0) {
+            erosion_kernel_x = cv::Mat::ones(1, 2 * processing.depth_x_erosion + 1, CV_8UC1);
+        }
+        if (processing.depth_y_erosion > 0) {
+            erosion_kernel_y = cv::Mat::ones(2 * processing.depth_y_erosion + 1, 1, CV_8UC1);
+        }
+        if (processing.background_frames > BACKGROUND_FRAMES_MAX) {
+            _log_error("processing.background_frames must be at most " + std::to_string(BACKGROUND_FRAMES_MAX));
+            return false;
+        }
+        if (processing.incremental_tile_size < 0) {
+            _log_error("processing.incremental_tile_size must not be negative");
+            return false;
+        }
+        if (processing.greenscreen_removal) {
+            // Build the classification table now, not when the first frame arrives.
+            orbbec_greenscreen_lut();
+        }
         return true;
     }
     /// Apply filter to a frameset.
@@ -296,172 +408,706 @@ protected:
         return true; 
     }
 
-    virtual void _apply_filters() final {
-        // xxxjack to be implemented, maybe
+    /// Apply the depth image filters (temporal filter, erosion) that run before point generation.
+    /// Returns the filtered depth image (in a buffer that is reused every frame), or depth if no filter is enabled.
+    const uint16_t* _apply_filters(const uint16_t* depth, int width, int height, float value_scale) {
+        if (filtering.do_temporal) {
+            depth = _temporal_filter_depth_image(depth, width, height, value_scale);
+        }
+        if (processing.flying_pixel_threshold > 0) {
+            depth = _remove_flying_pixels(depth, width, height);
+        }
+        depth = _erode_depth_image(depth, width, height);
+        return _subtract_background(depth, width, height, value_scale);
+    }
+
+    /// Background subtraction. While learning, accumulate the mean depth of every pixel.
+    /// Once learned, remove every pixel that is not at least background_tolerance in front of the background.
+    const uint16_t* _subtract_background(const uint16_t* depth, int width, int height, float value_scale) {
+        size_t npixel = (size_t)width * height;
+        int request = background_request.exchange(-1);
+        if (request >= 0 || (background_learned && background_depth.size() != npixel)) {
+            // New request, or the resolution has changed so the old background is useless.
+            if (request < 0) request = background_frames_wanted;
+            background_learned = false;
+            background_depth.clear();
+            background_frames_wanted = request;
+            background_frames_learned = 0;
+            if (request > 0) {
+                background_sum.assign(npixel, 0);
+                background_count.assign(npixel, 0);
+                if (debug) _log_debug("learning background from " + std::to_string(request) + " frames");
+            }
+        }
+        if (background_frames_learned < background_frames_wanted) {
+            if (background_sum.size() != npixel) {
+                background_sum.assign(npixel, 0);
+                background_count.assign(npixel, 0);
+                background_frames_learned = 0;
+            }
+            for (size_t idx = 0; idx < npixel; idx++) {
+                if (depth[idx] == 0) continue;
+                background_sum[idx] += depth[idx];
+                background_count[idx]++;
+            }
+            if (++background_frames_learned == background_frames_wanted) {
+                background_depth.resize(npixel);
+                for (size_t idx = 0; idx < npixel; idx++) {
+                    // Pixels that never had a depth have no background, so they are never removed.
+                    background_depth[idx] = background_count[idx] == 0 ? 0 : (uint16_t)((background_sum[idx] + background_count[idx] / 2) / background_count[idx]);
+                }
+                background_sum.clear();
+                background_count.clear();
+                background_learned = true;
+                if (debug) _log_debug("background learned");
+            }
+            return depth;
+        }
+        if (!background_learned) return depth;
+        int tolerance = (int)(processing.background_tolerance * 1000.0 / value_scale);
+        background_filtered_depth.resize(npixel);
+        OrbbecWorkerPool::instance().run_rows(0, height, [&](int band, int first_row, int end_row) {
+            for (size_t idx = (size_t)first_row * width; idx < (size_t)end_row * width; idx++) {
+                int background = background_depth[idx];
+                bool is_background = background != 0 && depth[idx] + tolerance >= background;
+                background_filtered_depth[idx] = is_background ? 0 : depth[idx];
+            }
+        });
+        return background_filtered_depth.data();
+    }
+
+    /// Remove flying pixels: pixels at a depth discontinuity that got a depth between the foreground
+    /// and the background. A pixel is removed if its depth differs from both its left and right neighbours,
+    /// or from both its upper and lower neighbours, by more than flying_pixel_threshold times its depth.
+    /// Real edge pixels are kept because they have the same depth as the neighbour on their own side.
+    const uint16_t* _remove_flying_pixels(const uint16_t* depth, int width, int height) {
+        flying_pixel_depth.resize((size_t)width * height);
+        float ratio = (float)processing.flying_pixel_threshold;
+        OrbbecWorkerPool::instance().run_rows(0, height, [&](int band, int first_row, int end_row) {
+            for (int v = first_row; v < end_row; v++) {
+                const uint16_t* row = depth + (size_t)v * width;
+                const uint16_t* row_above = v > 0 ? row - width : nullptr;
+                const uint16_t* row_below = v < height - 1 ? row + width : nullptr;
+                uint16_t* out = flying_pixel_depth.data() + (size_t)v * width;
+                for (int u = 0; u < width; u++) {
+                    int d = row[u];
+                    out[u] = d;
+                    if (d == 0) continue;
+                    int threshold = (int)(ratio * d);
+                    // Neighbours without depth tell us nothing, so they never cause removal.
+                    auto jumps = [&](int n) { return n != 0 && std::abs(d - n) > threshold; };
+                    bool flying_x = u > 0 && u < width - 1 && jumps(row[u-1]) && jumps(row[u+1]);
+                    bool flying_y = row_above && row_below && jumps(row_above[u]) && jumps(row_below[u]);
+                    if (flying_x || flying_y) {
+                        out[u] = 0;
+                    }
+                }
+            }
+        });
+        return flying_pixel_depth.data();
+    }
+
+    /// Temporal filter: an exponential moving average of every depth pixel over the frames.
+    /// A pixel that becomes invalid, or jumps by more than temporal_delta, restarts from the new value
+    /// so moving objects do not leave trails.
+    const uint16_t* _temporal_filter_depth_image(const uint16_t* depth, int width, int height, float value_scale) {
+        size_t npixel = (size_t)width * height;
+        if (temporal_history.size() != npixel) {
+            temporal_history.assign(npixel, 0.0f);
+            temporal_depth.resize(npixel);
+        }
+        float alpha = (float)filtering.temporal_alpha;
+        float delta = (float)(filtering.temporal_delta * 1000.0 / value_scale);
+        OrbbecWorkerPool::instance().run_rows(0, height, [&](int band, int first_row, int end_row) {
+            for (size_t idx = (size_t)first_row * width; idx < (size_t)end_row * width; idx++) {
+                float value = (float)depth[idx];
+                float history = temporal_history[idx];
+                if (value == 0 || history == 0 || std::abs(value - history) > delta) {
+                    history = value;
+                } else {
+                    history += alpha * (value - history);
+                }
+                temporal_history[idx] = history;
+                temporal_depth[idx] = (uint16_t)(history + 0.5f);
+            }
+        });
+        return temporal_depth.data();
     }
     virtual void _start_capture_thread() = 0;
     virtual void _capture_thread_main() = 0;
-    void _start_processing_thread() {
-        camera_processing_thread = new std::thread(&OrbbecBaseCamera::_processing_thread_main, this);
-        _cwipc_setThreadName(camera_processing_thread, L"cwipc_orbbec::camera_processing_thread");
+    /// There is no processing thread per camera: framesets are processed by tasks on the shared
+    /// worker pool, submitted by process_pointcloud_from_frameset().
+    void _start_processing() {
+        if(debug) _log_debug_thread("frame processing started");
     }
 
-    void _processing_thread_main() {
-        if(debug) _log_debug_thread("frame processing thread started");
-        while (!camera_stopped) {
-            if (debug) _log_debug_thread("11. wait for processing_frame_queue");
+    /// Worker pool task: process the framesets in processing_queue until it is empty.
+    /// At most one of these runs per camera, so the per-camera filter state needs no locking.
+    void _process_queued_framesets() {
+        while (true) {
+            if (debug) _log_debug_thread("11. take from processing_queue");
             //
             // Get the frameset we need to turn into a point cloud
             ///
             std::shared_ptr<ob::FrameSet> processing_frameset;
-            bool ok = processing_frame_queue.wait_dequeue_timed(processing_frameset, std::chrono::milliseconds(10000));
-            if (end_of_stream_reached) break;
-            if (!ok) {
-                if (waiting_for_capture) _log_warning("processing thread dequeue timeout");
-                std::this_thread::yield();
-                continue;
+            uint64_t sequence = 0;
+            {
+                std::lock_guard<std::mutex> lock(processing_queue_mutex);
+                if (processing_queue.empty() || camera_stopped || end_of_stream_reached) {
+                    processing_task_active = false;
+                    // Wakes up stop_camera() and a blocked process_pointcloud_from_frameset().
+                    processing_queue_cv.notify_all();
+                    return;
+                }
+                processing_frameset = processing_queue.front().frameset;
+                sequence = processing_queue.front().sequence;
+                processing_queue.pop_front();
+                // There is room in the queue again.
+                processing_queue_cv.notify_all();
             }
             waiting_for_capture = false;
             if (processing_frameset == nullptr) {
-                if (!camera_stopped) _log_error("processing thread dequeue produced NULL pointer");
-                break;
+                _log_error("processing task dequeue produced NULL pointer");
+                continue;
             }
-            if (debug) _log_debug_thread("processing thread got frameset");
-            assert(processing_frameset);
-            if (debug) _log_debug_thread("12. Lock processing_mutex");
-            std::lock_guard<std::mutex> lock(processing_mutex);
+            if (debug) _log_debug_thread("processing task got frameset");
+            _process_frameset(sequence, processing_frameset);
+        }
+    }
+
+    /// Turn one frameset into a point cloud and hand it to wait_for_pointcloud_processed().
+    void _process_frameset(uint64_t sequence, std::shared_ptr<ob::FrameSet> processing_frameset) {
 #if 0
-            //
-            // use body tracker for skeleton extraction
-            //
-            if (tracker_handle) {
-                _feed_frameset_to_tracker(processing_frameset);
-            }
+        //
+        // use body tracker for skeleton extraction
+        //
+        if (tracker_handle) {
+            _feed_frameset_to_tracker(processing_frameset);
+        }
 #endif
-            //
-            // get depth and color images. Apply filters and uncompress color image if needed
-            //
-            std::shared_ptr<ob::Frame> depth_frame = processing_frameset->getFrame(OB_FRAME_DEPTH);
-            if (depth_frame == nullptr) {
-                _log_warning("empty point cloud, missing depth frame in frameset " + std::to_string(processing_frameset->getIndex()));
-                current_pcl_pointcloud = new_cwipc_pcl_pointcloud();
-                processing_done = true;
-                processing_done_cv.notify_one();
-                continue;
-            }
-            std::shared_ptr<ob::DepthFrame> depth_image = depth_frame->as<ob::DepthFrame>();
-            std::shared_ptr<ob::Frame> color_frame = processing_frameset->getFrame(OB_FRAME_COLOR);
-            if (color_frame == nullptr) {
-                _log_warning("missing color frame in frameset " + std::to_string(processing_frameset->getIndex()));
-                current_pcl_pointcloud = new_cwipc_pcl_pointcloud();
-                processing_done = true;
-                processing_done_cv.notify_one();
-                continue;
-            }
-            std::shared_ptr<ob::ColorFrame> color_image = color_frame->as<ob::ColorFrame>();
-            if (debug) _log_debug(std::string("Processing frame:") +
-                    " depth: " + std::to_string(depth_frame->getIndex()) +":" + std::to_string(depth_image->getWidth()) + "x" + std::to_string(depth_image->getHeight()) +
-                    " color: " + std::to_string(color_frame->getIndex()) +":"  + std::to_string(color_image->getWidth()) + "x" + std::to_string(color_image->getHeight()));
-            //
-            // Do processing on the images (filtering, decompressing)
-            //
+        //
+        // get depth and color images. Apply filters and uncompress color image if needed
+        //
+        std::shared_ptr<ob::Frame> depth_frame = processing_frameset->getFrame(OB_FRAME_DEPTH);
+        if (depth_frame == nullptr) {
+            _log_warning("empty point cloud, missing depth frame in frameset " + std::to_string(processing_frameset->getIndex()));
+            _push_processed_frame(sequence, new_cwipc_pcl_pointcloud(), processing_frameset);
+            return;
+        }
+        std::shared_ptr<ob::DepthFrame> depth_image = depth_frame->as<ob::DepthFrame>();
+        std::shared_ptr<ob::Frame> color_frame = processing_frameset->getFrame(OB_FRAME_COLOR);
+        if (color_frame == nullptr) {
+            _log_warning("missing color frame in frameset " + std::to_string(processing_frameset->getIndex()));
+            _push_processed_frame(sequence, new_cwipc_pcl_pointcloud(), processing_frameset);
+            return;
+        }
+        std::shared_ptr<ob::ColorFrame> color_image = color_frame->as<ob::ColorFrame>();
+        if (debug) _log_debug(std::string("Processing frame:") +
+                " depth: " + std::to_string(depth_frame->getIndex()) +":" + std::to_string(depth_image->getWidth()) + "x" + std::to_string(depth_image->getHeight()) +
+                " color: " + std::to_string(color_frame->getIndex()) +":"  + std::to_string(color_image->getWidth()) + "x" + std::to_string(color_image->getHeight()));
+        //
+        // Do processing on the images (filtering, decompressing)
+        //
 #if 0
-            // xxxjack to do
-            _apply_filters_to_depth_image(depth_image); //filtering depthmap => better now because if we map depth to color then we need to filter more points.
-            color_image = _uncompress_color_image(processing_frameset, color_image);
+        // xxxjack to do
+        _apply_filters_to_depth_image(depth_image); //filtering depthmap => better now because if we map depth to color then we need to filter more points.
+        color_image = _uncompress_color_image(processing_frameset, color_image);
 #endif
-            // Keep frameset for metadata, map2d3d, etc.
-            current_processed_frameset = processing_frameset;
+        //  
+        // generate pointcloud
+        //
+        if (debug) _log_debug_thread("13. _generate_pointcloud()");
+        cwipc_pcl_pointcloud new_pointcloud = nullptr;
+        new_pointcloud = _generate_point_cloud(processing_frameset);
 
-            //  
-            // generate pointcloud
-            //
-            if (debug) _log_debug_thread("13. _generate_pointcloud()");
-            cwipc_pcl_pointcloud new_pointcloud = nullptr;
-            new_pointcloud = _generate_point_cloud(processing_frameset);
-
-            if (new_pointcloud != nullptr) {
-                current_pcl_pointcloud = new_pointcloud;
-                if (debug) _log_debug_thread("generated pointcloud with " + std::to_string(current_pcl_pointcloud->size()) + " points");
+        if (new_pointcloud != nullptr) {
+            if (debug) _log_debug_thread("generated pointcloud with " + std::to_string(new_pointcloud->size()) + " points");
 
-                if (current_pcl_pointcloud->size() == 0) {
-                    _log_warning("Captured empty pointcloud from camera");
-                    //continue;
-                }
-                //
-                // Notify wait_for_pointcloud_processed that we're done.
-                //
-                processing_done = true;
-                processing_done_cv.notify_one();
-                if (debug) _log_debug_thread("14. notified processing_done_cv");
-            } else {
-                _log_warning("_generate_point_cloud() returned NULL");
+            if (new_pointcloud->size() == 0) {
+                _log_warning("Captured empty pointcloud from camera");
+                //continue;
             }
-            //
-            // No cleanup needed, orbbec API handles it.
-            //
+        } else {
+            _log_warning("_generate_point_cloud() returned NULL");
+            new_pointcloud = new_cwipc_pcl_pointcloud();
         }
-        if (camera_started && camera_pipeline != nullptr) {
-            camera_pipeline->stop();
-            camera_pipeline = nullptr;
-            camera_started = false;
+        //
+        // Notify wait_for_pointcloud_processed that we're done. Every frameset produces a point cloud,
+        // so with multiple frames in flight the capturer can match them up.
+        //
+        _push_processed_frame(sequence, new_pointcloud, processing_frameset);
+        if (debug) _log_debug_thread("14. notified processing_done_cv");
+        //
+        // No cleanup needed, orbbec API handles it.
+        //
+    }
+
+    /// Hand the point cloud of frame sequence (and the normals in generated_normals) to wait_for_pointcloud_processed().
+    void _push_processed_frame(uint64_t sequence, cwipc_pcl_pointcloud pointcloud, std::shared_ptr<ob::FrameSet> frameset) {
+        {
+            std::lock_guard<std::mutex> lock(processing_mutex);
+            ProcessedFrame& frame = processed_frames[_insert_processed_frame(sequence)];
+            frame.pointcloud = pointcloud;
+            frame.normals.swap(generated_normals);
+            frame.frameset = frameset;
+        }
+        generated_normals.clear();
+        processing_done_cv.notify_all();
+    }
+
+    /// Count a dropped frame, and give it an empty point cloud so the capturer waiting for it is not stuck.
+    /// Called with processing_queue_mutex held.
+    void _drop_frame(uint64_t sequence) {
+        dropped_frame_count++;
+        _log_warning("processing queue full, dropping frame " + std::to_string(sequence));
+        {
+            std::lock_guard<std::mutex> lock(processing_mutex);
+            ProcessedFrame& frame = processed_frames[_insert_processed_frame(sequence)];
+            frame.pointcloud = new_cwipc_pcl_pointcloud();
+        }
+        processing_done_cv.notify_all();
+    }
+
+    /// Insert an empty entry for frame sequence in processed_frames, which is kept sorted by sequence
+    /// (a dropped frame may get its entry before an earlier frame has been processed). Call with processing_mutex held.
+    /// Returns the index of the entry.
+    size_t _insert_processed_frame(uint64_t sequence) {
+        size_t pos = processed_frames.size();
+        while (pos > 0 && processed_frames[pos - 1].sequence > sequence) {
+            pos--;
+        }
+        processed_frames.insert(processed_frames.begin() + pos, ProcessedFrame());
+        processed_frames[pos].sequence = sequence;
+        return pos;
+    }
+
+    /// Parse the processing queue configuration.
+    bool _init_processing_queue() {
+        processing_queue_size = configuration.processing_queue_size > 0 ? configuration.processing_queue_size : std::max(1, configuration.frames_in_flight);
+        const std::string& policy = configuration.processing_queue_policy;
+        if (policy == "drop_newest") {
+            processing_queue_policy = ORBBEC_QUEUE_DROP_NEWEST;
+        } else if (policy == "drop_oldest") {
+            processing_queue_policy = ORBBEC_QUEUE_DROP_OLDEST;
+        } else if (policy == "block") {
+            processing_queue_policy = ORBBEC_QUEUE_BLOCK;
+        } else {
+            _log_error("unknown system.processing_queue_policy " + policy);
+            return false;
         }
-        if (debug)_log_debug_thread("processing thread exiting");
+        return true;
     }
 
     cwipc_pcl_pointcloud _generate_point_cloud(std::shared_ptr<ob::FrameSet> frameset) {
         cwipc_pcl_pointcloud pcl_pointcloud = new_cwipc_pcl_pointcloud();
-        auto pointcloud_filter = std::make_shared<ob::PointCloudFilter>();
-        pointcloud_filter->setCreatePointFormat(OB_FORMAT_RGB_POINT);
-        std::shared_ptr<ob::Frame> pointcloud_frame = pointcloud_filter->process(frameset);
-        std::shared_ptr<ob::PointsFrame> points_frame = pointcloud_frame->as<ob::PointsFrame>();
-        auto format = points_frame->getFormat();
-        if (format != OB_FORMAT_RGB_POINT) {
-            _log_warning("_generate_point_cloud: format is not OB_FORMAT_RGB_POINT");
+        generated_normals.clear();
+        std::shared_ptr<ob::Frame> depth_frame = frameset->getFrame(OB_FRAME_DEPTH);
+        std::shared_ptr<ob::Frame> color_frame = frameset->getFrame(OB_FRAME_COLOR);
+        if (depth_frame == nullptr || color_frame == nullptr) {
+            _log_warning("_generate_point_cloud: missing depth or color frame");
             return pcl_pointcloud;
         }
-        uint32_t width  = points_frame->getWidth();
-        uint32_t height = points_frame->getHeight();
-
-        pcl_pointcloud->reserve(width*height);
-        OBColorPoint* points = reinterpret_cast<OBColorPoint *>(points_frame->getData());
-        float height_min = processing.height_min;
-        float height_max = processing.height_max;
-        bool do_height_filtering = height_min < height_max;
-        bool do_greenscreen_removal = processing.greenscreen_removal;
-        bool do_radius_filtering = processing.radius_filter > 0;
-        for (int idx = 0; idx < width*height; idx++) {
-            OBColorPoint *obpt = points + idx;
-            cwipc_pcl_point pt(obpt->x / 1000.0, obpt->y / 1000.0, obpt->z / 1000.0);
-            if (pt.z == 0) continue;
-            _transform_point_cam_to_world(pt);
-            if (do_height_filtering && (pt.y < height_min || pt.y > height_max)) {
-                continue;
+        if (depth_frame->format() != OB_FORMAT_Y16 || color_frame->format() != OB_FORMAT_BGRA) {
+            _log_warning("_generate_point_cloud: depth is not OB_FORMAT_Y16 or color is not OB_FORMAT_BGRA");
+            return pcl_pointcloud;
+        }
+        std::shared_ptr<ob::DepthFrame> depth_image = depth_frame->as<ob::DepthFrame>();
+        std::shared_ptr<ob::ColorFrame> color_image = color_frame->as<ob::ColorFrame>();
+        int width = (int)depth_image->getWidth();
+        int height = (int)depth_image->getHeight();
+        if (!filtering.map_color_to_depth && ((int)color_image->getWidth() != width || (int)color_image->getHeight() != height)) {
+            _log_warning("_generate_point_cloud: color image not aligned to depth image");
+            return pcl_pointcloud;
+        }
+        int decimation = processing.decimation;
+        double sample_offset = orbbec_decimation_sample_offset(decimation_mode, decimation);
+        OBCameraIntrinsic intrinsic;
+        OBCameraDistortion distortion;
+        if (!_get_depth_intrinsic(depth_image, color_image, intrinsic, distortion) || !deprojector.prepare(intrinsic, distortion, width, height, decimation, sample_offset)) {
+            _log_warning("_generate_point_cloud: cannot get usable depth intrinsics");
+            return pcl_pointcloud;
+        }
+        OrbbecWorkerPool& pool = OrbbecWorkerPool::instance();
+
+        OrbbecPointKernelParams params;
+        params.depth = _apply_filters(reinterpret_cast<const uint16_t *>(depth_image->getData()), width, height, depth_image->getValueScale());
+        params.color = color_image->getData();
+        if (filtering.map_color_to_depth) {
+            // Depth is at its native resolution. Look up the color of every depth pixel.
+            if (!_prepare_color_mapper(depth_image, color_image)) {
+                _log_warning("_generate_point_cloud: cannot map color to depth");
+                return pcl_pointcloud;
             }
-            if (do_radius_filtering && !isPointInRadius(pt, processing.radius_filter)) {
-                continue;
+            mapped_depth.resize((size_t)width * height);
+            mapped_color.resize((size_t)width * height * 4);
+            float value_scale = depth_image->getValueScale();
+            // Two passes: all pixels must be in the z-buffer before we can tell which ones are hidden.
+            color_mapper.begin_frame();
+            pool.run_rows(0, height, [&](int band, int first_row, int end_row) {
+                color_mapper.project_rows(params.depth, value_scale, first_row, end_row);
+            });
+            pool.run_rows(0, height, [&](int band, int first_row, int end_row) {
+                color_mapper.map_rows(params.depth, params.color, first_row, end_row, mapped_depth.data(), mapped_color.data());
+            });
+            params.depth = mapped_depth.data();
+            params.color = mapped_color.data();
+        }
+        if (decimation > 1) {
+            // From here on we work with the decimated images.
+            int full_width = width;
+            width = deprojector.width();
+            height = deprojector.height();
+            decimated_depth.resize((size_t)width * height);
+            decimated_color.resize((size_t)width * height * 4);
+            pool.run_rows(0, height, [&](int band, int first_row, int end_row) {
+                orbbec_decimate_rows(decimation_mode, decimation, params.depth, params.color, full_width, width, first_row, end_row, decimated_depth.data(), decimated_color.data());
+            });
+            params.depth = decimated_depth.data();
+            params.color = decimated_color.data();
+        }
+        params.width = width;
+        params.height = height;
+        params.ray_x = deprojector.rays_x();
+        params.ray_y = deprojector.rays_y();
+        // Depth values are in units of getValueScale() millimeters. Fold that into the matrix too.
+        float cam_to_world[12];
+        _update_cam_to_world_matrix(cam_to_world);
+        float value_scale = depth_image->getValueScale();
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 3; c++) {
+                params.trafo[r*4 + c] = cam_to_world[r*4 + c] * value_scale;
             }
-            // xxxjack NOTE: the color names in OBColorPoint seem to be mixed up.
-            pt.r = (uint8_t)(obpt->b);
-            pt.g = (uint8_t)(obpt->g);
-            pt.b = (uint8_t)(obpt->r);
-            pt.a = (uint8_t)(1 << camera_index);
-            if (do_greenscreen_removal && !isNotGreen(&pt)) {
-                continue;
+            params.trafo[r*4 + 3] = cam_to_world[r*4 + 3];
+        }
+        // Thresholding is done on the raw depth values, so pixels outside the range are never deprojected.
+        if (filtering.do_threshold) {
+            double units_per_meter = 1000.0 / value_scale;
+            params.depth_min = (uint16_t)std::min(65535.0, std::max(1.0, std::ceil(filtering.threshold_near * units_per_meter)));
+            params.depth_max = (uint16_t)std::min(65535.0, std::max(0.0, std::floor(filtering.threshold_far * units_per_meter)));
+        }
+        // Only look at the part of the image (and the range of depths) that can produce points inside the height and radius filters.
+        _update_depth_roi(value_scale);
+        if (depth_roi.empty()) {
+            return pcl_pointcloud;
+        }
+        double units_per_meter = 1000.0 / value_scale;
+        params.depth_min = std::max(params.depth_min, (uint16_t)std::min(65535.0, std::max(1.0, std::floor(depth_roi.z_min * units_per_meter) - 1)));
+        params.depth_max = std::min(params.depth_max, (uint16_t)std::min(65535.0, std::max(0.0, std::ceil(depth_roi.z_max * units_per_meter) + 1)));
+        params.first_col = depth_roi.first_col;
+        params.end_col = depth_roi.end_col;
+        params.height_min = processing.height_min;
+        params.height_max = processing.height_max;
+        params.do_height_filtering = params.height_min < params.height_max;
+        params.do_radius_filtering = processing.radius_filter > 0;
+        params.radius_squared = (float)(processing.radius_filter * processing.radius_filter);
+        params.do_greenscreen_removal = processing.greenscreen_removal;
+        params.tile = (uint8_t)(1 << camera_index);
+
+        size_t npixel = (size_t)width * height;
+        if (point_buffer.size() < npixel) {
+            point_buffer.resize(npixel);
+        }
+        if (params.do_greenscreen_removal) {
+            if (greenscreen_mask.size() < npixel) {
+                greenscreen_mask.resize(npixel);
+            }
+            params.greenscreen_mask = greenscreen_mask.data();
+        }
+        bool want_normals = metadata.want_normals;
+        if (want_normals) {
+            if (point_pixels.size() < npixel) {
+                point_pixels.resize(npixel);
+                point_normals.resize(3 * npixel);
+            }
+        }
+        OrbbecPointKernel point_kernel = point_kernels->select(params);
+        if (processing.incremental_tile_size > 0) {
+            _generate_points_incremental(params, point_kernel, value_scale, want_normals, pcl_pointcloud);
+            return pcl_pointcloud;
+        }
+        //
+        // Split the image into row bands, and have the worker pool run the kernel on each band.
+        // Each band stores its points in its own slice of point_buffer (starting at the index of its first pixel).
+        //
+        int nband = pool.row_band_count(depth_roi.end_row - depth_roi.first_row);
+        band_point_counts.assign(nband, 0);
+        band_first_rows.assign(nband, 0);
+        pool.run_rows(depth_roi.first_row, depth_roi.end_row, [&](int band, int first_row, int end_row) {
+            band_first_rows[band] = first_row;
+            if (params.do_greenscreen_removal) {
+                orbbec_greenscreen_mask_rows(params, first_row, end_row, greenscreen_mask.data());
+            }
+            size_t first_idx = (size_t)first_row * width;
+            uint32_t* pixels = want_normals ? point_pixels.data() + first_idx : nullptr;
+            band_point_counts[band] = point_kernel(params, first_row, end_row, point_buffer.data() + first_idx, pixels);
+            if (want_normals) {
+                orbbec_compute_normals(params, pixels, band_point_counts[band], point_normals.data() + 3 * first_idx);
+            }
+        });
+        //
+        // Compact the slices into the resulting point cloud.
+        //
+        size_t npoint = 0;
+        for (size_t count : band_point_counts) {
+            npoint += count;
+        }
+        if (processing.voxel_size > 0) {
+            // Downsample here, in this camera's processing thread, so merging only has to concatenate.
+            voxel_grid.begin((float)processing.voxel_size, npoint);
+            for (int band = 0; band < nband; band++) {
+                if (band_point_counts[band] == 0) continue;
+                size_t first_idx = (size_t)band_first_rows[band] * width;
+                voxel_grid.add(point_buffer.data() + first_idx, want_normals ? point_normals.data() + 3 * first_idx : nullptr, band_point_counts[band]);
+            }
+            _warn_voxel_grid_out_of_range();
+            voxel_grid.store(pcl_pointcloud, want_normals ? &generated_normals : nullptr);
+            return pcl_pointcloud;
+        }
+        pcl_pointcloud->reserve(npoint);
+        if (want_normals) {
+            generated_normals.reserve(3 * npoint);
+        }
+        for (int band = 0; band < nband; band++) {
+            if (band_point_counts[band] == 0) continue;
+            size_t first_idx = (size_t)band_first_rows[band] * width;
+            auto slice = point_buffer.begin() + first_idx;
+            pcl_pointcloud->insert(pcl_pointcloud->end(), slice, slice + band_point_counts[band]);
+            if (want_normals) {
+                auto normals_slice = point_normals.begin() + 3 * first_idx;
+                generated_normals.insert(generated_normals.end(), normals_slice, normals_slice + 3 * band_point_counts[band]);
             }
-            pcl_pointcloud->push_back(pt);
         }
         return pcl_pointcloud;
     }
 
-    void _transform_point_cam_to_world(cwipc_pcl_point& pt) {
-    float x = (*camera_config.trafo)(0,0)*pt.x + (*camera_config.trafo)(0,1)*pt.y + (*camera_config.trafo)(0,2)*pt.z + (*camera_config.trafo)(0,3);
-    float y = (*camera_config.trafo)(1,0)*pt.x + (*camera_config.trafo)(1,1)*pt.y + (*camera_config.trafo)(1,2)*pt.z + (*camera_config.trafo)(1,3);
-    float z = (*camera_config.trafo)(2,0)*pt.x + (*camera_config.trafo)(2,1)*pt.y + (*camera_config.trafo)(2,2)*pt.z + (*camera_config.trafo)(2,3);
-    pt.x = x;
-    pt.y = y;
-    pt.z = z;
-}
+    /// Incremental version of the second half of _generate_point_cloud: split the image into tiles, and only
+    /// run the kernel on the tiles whose depth has changed by more than incremental_tolerance since their
+    /// points were last generated. The points of the other tiles are taken from tile_cache.
+    void _generate_points_incremental(const OrbbecPointKernelParams& params, OrbbecPointKernel point_kernel, float value_scale, bool want_normals, cwipc_pcl_pointcloud& pcl_pointcloud) {
+        // Cached points are only valid if everything except the depth image is the same as when they were generated.
+        double source[TILE_CACHE_SOURCE_SIZE] = {
+            params.trafo[0], params.trafo[1], params.trafo[2], params.trafo[3],
+            params.trafo[4], params.trafo[5], params.trafo[6], params.trafo[7],
+            params.trafo[8], params.trafo[9], params.trafo[10], params.trafo[11],
+            (double)params.depth_min, (double)params.depth_max,
+            (double)depth_roi.first_col, (double)depth_roi.end_col, (double)depth_roi.first_row, (double)depth_roi.end_row,
+            params.height_min, params.height_max, processing.radius_filter,
+            (double)params.do_greenscreen_removal, (double)params.tile,
+            (double)deprojector.generation(), (double)decimation_mode, (double)filtering.map_color_to_depth
+        };
+        bool invalidate = !std::equal(source, source + TILE_CACHE_SOURCE_SIZE, tile_cache_source);
+        std::copy(source, source + TILE_CACHE_SOURCE_SIZE, tile_cache_source);
+        tile_cache.begin(params.width, params.height, processing.incremental_tile_size, want_normals, invalidate);
+        uint16_t tolerance = (uint16_t)std::min(65535.0, std::max(0.0, std::round(processing.incremental_tolerance * 1000.0 / value_scale)));
+        std::atomic<int> nchanged(0);
+        OrbbecWorkerPool::instance().run(tile_cache.tile_count(), [&](int tile) {
+            int first_col, end_col, first_row, end_row;
+            tile_cache.tile_rect(tile, first_col, end_col, first_row, end_row);
+            first_col = std::max(first_col, depth_roi.first_col);
+            end_col = std::min(end_col, depth_roi.end_col);
+            first_row = std::max(first_row, depth_roi.first_row);
+            end_row = std::min(end_row, depth_roi.end_row);
+            if (first_col >= end_col || first_row >= end_row) {
+                tile_cache.clear(tile);
+                return;
+            }
+            if (!tile_cache.changed(tile, params.depth, tolerance, params.color, processing.incremental_color_tolerance, processing.incremental_refresh_frames)) return;
+            nchanged++;
+            OrbbecPointKernelParams tile_params = params;
+            tile_params.first_col = first_col;
+            tile_params.end_col = end_col;
+            if (tile_params.do_greenscreen_removal) {
+                orbbec_greenscreen_mask_rows(tile_params, first_row, end_row, greenscreen_mask.data());
+            }
+            size_t count = point_kernel(tile_params, first_row, end_row, tile_cache.points(tile), tile_cache.pixels(tile));
+            if (want_normals) {
+                orbbec_compute_normals(tile_params, tile_cache.pixels(tile), count, tile_cache.normals(tile));
+            }
+            tile_cache.set_count(tile, count);
+        });
+        if (debug) _log_debug("incremental: regenerated " + std::to_string(nchanged.load()) + " of " + std::to_string(tile_cache.tile_count()) + " tiles");
+        size_t npoint = tile_cache.total();
+        if (processing.voxel_size > 0) {
+            voxel_grid.begin((float)processing.voxel_size, npoint);
+            for (int tile = 0; tile < tile_cache.tile_count(); tile++) {
+                if (tile_cache.count(tile) == 0) continue;
+                voxel_grid.add(tile_cache.points(tile), tile_cache.normals(tile), tile_cache.count(tile));
+            }
+            _warn_voxel_grid_out_of_range();
+            voxel_grid.store(pcl_pointcloud, want_normals ? &generated_normals : nullptr);
+            return;
+        }
+        pcl_pointcloud->reserve(npoint);
+        if (want_normals) {
+            generated_normals.reserve(3 * npoint);
+        }
+        for (int tile = 0; tile < tile_cache.tile_count(); tile++) {
+            size_t count = tile_cache.count(tile);
+            if (count == 0) continue;
+            const cwipc_pcl_point* points = tile_cache.points(tile);
+            pcl_pointcloud->insert(pcl_pointcloud->end(), points, points + count);
+            if (want_normals) {
+                const float* normals = tile_cache.normals(tile);
+                generated_normals.insert(generated_normals.end(), normals, normals + 3 * count);
+            }
+        }
+    }
+
+    /// Apply depth_x_erosion and depth_y_erosion: remove valid depth pixels that are within that many
+    /// pixels (horizontally or vertically) of an invalid one. These are usually flying pixels at object edges.
+    /// Returns the eroded depth image (in a buffer that is reused every frame), or depth if there is no erosion.
+    const uint16_t* _erode_depth_image(const uint16_t* depth, int width, int height) {
+        bool erode_x = processing.depth_x_erosion > 0;
+        bool erode_y = processing.depth_y_erosion > 0;
+        if (!erode_x && !erode_y) return depth;
+        cv::Mat depth_mat(height, width, CV_16UC1, const_cast<uint16_t*>(depth));
+        cv::compare(depth_mat, 0, erosion_valid, cv::CMP_NE);
+        // Eroding with a cross is separable: erode in x and in y independently and combine the results.
+        if (erode_x) {
+            cv::erode(erosion_valid, erosion_valid_x, erosion_kernel_x);
+        }
+        if (erode_y) {
+            cv::erode(erosion_valid, erosion_valid_y, erosion_kernel_y);
+        }
+        if (erode_x && erode_y) {
+            cv::bitwise_and(erosion_valid_x, erosion_valid_y, erosion_valid);
+        }
+        const cv::Mat& keep = erode_x && erode_y ? erosion_valid : erode_x ? erosion_valid_x : erosion_valid_y;
+        eroded_depth.create(height, width, CV_16UC1);
+        eroded_depth.setTo(0);
+        depth_mat.copyTo(eroded_depth, keep);
+        return eroded_depth.ptr<uint16_t>();
+    }
+
+    /// Ensure color_mapper maps from the depth stream to the color stream of these frames.
+    bool _prepare_color_mapper(std::shared_ptr<ob::DepthFrame> depth_image, std::shared_ptr<ob::ColorFrame> color_image) {
+        std::shared_ptr<ob::StreamProfile> depth_profile = depth_image->getStreamProfile();
+        std::shared_ptr<ob::StreamProfile> color_profile = color_image->getStreamProfile();
+        if (depth_profile == nullptr || color_profile == nullptr) return false;
+        std::shared_ptr<ob::VideoStreamProfile> depth_video_profile = depth_profile->as<ob::VideoStreamProfile>();
+        std::shared_ptr<ob::VideoStreamProfile> color_video_profile = color_profile->as<ob::VideoStreamProfile>();
+        if (depth_video_profile == nullptr || color_video_profile == nullptr) return false;
+        return color_mapper.prepare(
+            depth_video_profile->getIntrinsic(), depth_video_profile->getDistortion(), depth_image->getWidth(), depth_image->getHeight(),
+            color_video_profile->getIntrinsic(), color_video_profile->getDistortion(), color_image->getWidth(), color_image->getHeight(),
+            depth_video_profile->getExtrinsicTo(color_profile)
+        );
+    }
+
+    /// Get the intrinsics and lens distortion that describe the depth image. With depth-to-color alignment the depth
+    /// image has been reprojected into the color camera, so we need the color intrinsics (the aligned image is treated as undistorted).
+    /// With map_color_to_depth the depth image is native, so we need the depth intrinsics and distortion.
+    bool _get_depth_intrinsic(std::shared_ptr<ob::DepthFrame> depth_image, std::shared_ptr<ob::ColorFrame> color_image, OBCameraIntrinsic& intrinsic, OBCameraDistortion& distortion) {
+        std::shared_ptr<ob::StreamProfile> depth_profile = depth_image->getStreamProfile();
+        std::shared_ptr<ob::StreamProfile> color_profile = color_image->getStreamProfile();
+        if (depth_profile == nullptr || color_profile == nullptr) return false;
+        std::shared_ptr<ob::VideoStreamProfile> depth_video_profile = depth_profile->as<ob::VideoStreamProfile>();
+        std::shared_ptr<ob::VideoStreamProfile> color_video_profile = color_profile->as<ob::VideoStreamProfile>();
+        if (depth_video_profile == nullptr || color_video_profile == nullptr) return false;
+        // The pipeline was configured with ALIGN_DISABLE for map_color_to_depth, ALIGN_D2C_HW_MODE otherwise.
+        if (filtering.map_color_to_depth) {
+            intrinsic = depth_video_profile->getIntrinsic();
+            distortion = depth_video_profile->getDistortion();
+        } else {
+            intrinsic = color_video_profile->getIntrinsic();
+            distortion = {};
+        }
+        if (intrinsic.width != (int)depth_image->getWidth() || intrinsic.height != (int)depth_image->getHeight()) {
+            _log_warning("_get_depth_intrinsic: intrinsics are for " + std::to_string(intrinsic.width) + "x" + std::to_string(intrinsic.height) +
+                " but depth image is " + std::to_string(depth_image->getWidth()) + "x" + std::to_string(depth_image->getHeight()));
+            return false;
+        }
+        return true;
+    }
+
+    /// Rebuild cam_to_world_mm if the camera trafo has changed since it was last built.
+    /// If matrix is not nullptr the (up to date) matrix is copied to it. Used by both the
+    /// processing task and API threads (map2d3d), so they never see a half-rebuilt matrix.
+    void _update_cam_to_world_matrix(float* matrix=nullptr) {
+        std::lock_guard<std::mutex> mylock(cam_to_world_mutex);
+        const Eigen::Affine3d& trafo = *camera_config.trafo;
+        bool changed = false;
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 4; c++) {
+                if (cam_to_world_source[r*4 + c] != trafo(r, c)) changed = true;
+            }
+        }
+        if (changed) {
+            _rebuild_cam_to_world_matrix(trafo);
+        }
+        if (matrix != nullptr) {
+            std::copy(cam_to_world_mm, cam_to_world_mm + 12, matrix);
+        }
+    }
+
+    /// Rebuild cam_to_world_mm from trafo. cam_to_world_mutex must be held.
+    void _rebuild_cam_to_world_matrix(const Eigen::Affine3d& trafo) {
+        for (int r = 0; r < 3; r++) {
+            for (int c = 0; c < 4; c++) {
+                cam_to_world_source[r*4 + c] = trafo(r, c);
+                // Input is in millimeters, output in meters: scale the rotation part, not the translation.
+                double scale = c < 3 ? 0.001 : 1.0;
+                cam_to_world_mm[r*4 + c] = (float)(trafo(r, c) * scale);
+            }
+        }
+        if (debug) _log_debug("rebuilt camera-to-world matrix");
+    }
+
+    /// Recompute depth_roi if the filter volume, the thresholds, the camera trafo or the
+    /// intrinsics have changed since it was last computed.
+    void _update_depth_roi(double value_scale) {
+        const Eigen::Affine3d& trafo = *camera_config.trafo;
+        double source[DEPTH_ROI_SOURCE_SIZE] = {
+            trafo(0, 0), trafo(0, 1), trafo(0, 2), trafo(0, 3),
+            trafo(1, 0), trafo(1, 1), trafo(1, 2), trafo(1, 3),
+            trafo(2, 0), trafo(2, 1), trafo(2, 2), trafo(2, 3),
+            processing.height_min, processing.height_max, processing.radius_filter,
+            (double)filtering.do_threshold, filtering.threshold_near, filtering.threshold_far,
+            value_scale, (double)deprojector.generation()
+        };
+        if (std::equal(source, source + DEPTH_ROI_SOURCE_SIZE, depth_roi_source)) return;
+        std::copy(source, source + DEPTH_ROI_SOURCE_SIZE, depth_roi_source);
+        // The volume is the height slab and the bounding box of the radius cylinder. Unfiltered directions are unbounded.
+        Eigen::Vector3d world_min = Eigen::Vector3d::Constant(-INFINITY);
+        Eigen::Vector3d world_max = Eigen::Vector3d::Constant(INFINITY);
+        if (processing.height_min < processing.height_max) {
+            world_min.y() = processing.height_min;
+            world_max.y() = processing.height_max;
+        }
+        if (processing.radius_filter > 0) {
+            world_min.x() = world_min.z() = -processing.radius_filter;
+            world_max.x() = world_max.z() = processing.radius_filter;
+        }
+        // Depth values are in units of value_scale millimeters, and 0 means no depth.
+        double z_near = value_scale / 1000.0;
+        double z_far = 65535 * value_scale / 1000.0;
+        if (filtering.do_threshold) {
+            z_near = std::max(z_near, filtering.threshold_near);
+            z_far = std::min(z_far, filtering.threshold_far);
+        }
+        deprojector.compute_roi(trafo, world_min, world_max, z_near, z_far, depth_roi);
+        if (debug) {
+            _log_debug("depth roi: columns " + std::to_string(depth_roi.first_col) + "-" + std::to_string(depth_roi.end_col) +
+                ", rows " + std::to_string(depth_roi.first_row) + "-" + std::to_string(depth_roi.end_row) +
+                ", z " + std::to_string(depth_roi.z_min) + "-" + std::to_string(depth_roi.z_max));
+        }
+    }
+
+    /// Warn if voxel_grid had to drop points because they are too far away for voxel_size.
+    void _warn_voxel_grid_out_of_range() {
+        if (voxel_grid.out_of_range() > 0) {
+            _log_warning("voxel_size: dropped " + std::to_string(voxel_grid.out_of_range()) + " points too far from the origin");
+        }
+    }
+
+    /// Transform a camera-space point in millimeters to world coordinates in meters.
+    void _transform_point_cam_to_world(float x, float y, float z, float* out3d) {
+        float m[12];
+        _update_cam_to_world_matrix(m);
+        out3d[0] = m[0]*x + m[1]*y + m[2]*z + m[3];
+        out3d[1] = m[4]*x + m[5]*y + m[6]*z + m[7];
+        out3d[2] = m[8]*x + m[9]*y + m[10]*z + m[11];
+    }
 
 public:
     float pointSize = 0;
@@ -480,21 +1126,88 @@ protected:
     Type_api_camera camera_device = nullptr;
     std::shared_ptr<ob::Pipeline> camera_pipeline = nullptr;
     bool camera_started = false;
-    bool camera_stopped = true;
+    std::atomic<bool> camera_stopped{true};  //<! Read by pool tasks, the control thread and the merge thread without a lock
     std::thread *camera_capturer_thread;
-    std::thread* camera_processing_thread = nullptr; //<! Handle for thread that runs processing loop
-    cwipc_pcl_pointcloud current_pcl_pointcloud = nullptr;  //<! Most recent grabbed pointcloud
+    cwipc_pcl_pointcloud current_pcl_pointcloud = nullptr;  //<! Most recent grabbed pointcloud. Protected by processing_mutex.
+    OrbbecDeprojector deprojector;  //<! Turns depth images into camera-space points
+    std::mutex cam_to_world_mutex;  //<! Protects cam_to_world_mm and cam_to_world_source
+    float cam_to_world_mm[12] = {};  //<! Camera (millimeters) to world (meters) transform, 3x4 row-major
+    double cam_to_world_source[12] = {};  //<! camera_config.trafo values cam_to_world_mm was built from
+    const OrbbecPointKernelSet* point_kernels = nullptr;  //<! Fastest point kernels for this CPU
+    std::vector<cwipc_pcl_point, Eigen::aligned_allocator<cwipc_pcl_point>> point_buffer;  //<! Kernel output, reused every frame
+    std::vector<size_t> band_point_counts;  //<! Number of points the kernel produced for each row band
+    std::vector<int> band_first_rows;  //<! First row of each row band, its points start at that row's first pixel in point_buffer
+    std::vector<uint32_t> point_pixels;  //<! Depth pixel of every point in point_buffer, when computing normals
+    std::vector<float> point_normals;  //<! Normal of every point in point_buffer, when computing normals
+    std::vector<float> current_normals;  //<! Normals of current_pcl_pointcloud
+    std::vector<float> generated_normals;  //<! Normals of the point cloud being generated by the processing thread
+    OrbbecColorMapper color_mapper;  //<! Color lookup for map_color_to_depth
+    std::vector<uint16_t> mapped_depth;  //<! Depth image without pixels that have no color, reused every frame
+    std::vector<uint8_t> mapped_color;  //<! Color of every depth pixel (BGRA), reused every frame
+    OrbbecDecimationMode decimation_mode = ORBBEC_DECIMATION_STRIDE;  //<! Parsed processing.decimation_mode
+    std::vector<uint16_t> decimated_depth;  //<! Decimated depth image, reused every frame
+    std::vector<uint8_t> decimated_color;  //<! Color of the decimated depth pixels (BGRA), reused every frame
+    std::vector<uint8_t> greenscreen_mask;  //<! Greenscreen classification of every pixel, reused every frame
+    std::atomic<int> background_request;  //<! Pending learn_background() request, or -1
+    int background_frames_wanted = 0;  //<! Number of frames to learn the background from
+    int background_frames_learned = 0;  //<! Number of frames learned so far
+    bool background_learned = false;  //<! True when background_depth is valid
+    std::vector<uint32_t> background_sum;  //<! Sum of the valid depths of every pixel while learning
+    std::vector<uint16_t> background_count;  //<! Number of valid depths of every pixel while learning
+    static const int BACKGROUND_FRAMES_MAX = 65535;  //<! So background_count cannot overflow, and background_sum neither (65535 * 65535 < 2^32)
+    static const int BACKGROUND_FRAMES_DEFAULT = 30;  //<! Frames learned when learn_background does not say how many and processing.background_frames is 0
+    std::vector<uint16_t> background_depth;  //<! Learned background depth of every pixel (0: none)
+    std::vector<uint16_t> background_filtered_depth;  //<! Depth image with background removed, reused every frame
+    OrbbecVoxelGrid voxel_grid;  //<! Per-camera voxel downsampling, reused every frame
+    std::vector<float> temporal_history;  //<! Temporal filter state: smoothed depth of every pixel
+    std::vector<uint16_t> temporal_depth;  //<! Temporally filtered depth image, reused every frame
+    std::vector<uint16_t> flying_pixel_depth;  //<! Depth image with flying pixels removed, reused every frame
+    cv::Mat erosion_kernel_x;  //<! Structuring element for depth_x_erosion
+    cv::Mat erosion_kernel_y;  //<! Structuring element for depth_y_erosion
+    cv::Mat erosion_valid;     //<! Depth validity mask, reused every frame
+    cv::Mat erosion_valid_x;   //<! Validity mask eroded in x, reused every frame
+    cv::Mat erosion_valid_y;   //<! Validity mask eroded in y, reused every frame
+    cv::Mat eroded_depth;      //<! Eroded depth image, reused every frame
+    static const int DEPTH_ROI_SOURCE_SIZE = 20;
+    OrbbecDepthRoi depth_roi;  //<! Part of the depth image that can produce points that pass the filters
+    double depth_roi_source[DEPTH_ROI_SOURCE_SIZE] = {};  //<! Values depth_roi was computed from
+    static const int TILE_CACHE_SOURCE_SIZE = 26;
+    OrbbecTileCache tile_cache;  //<! Points of the depth tiles, for incremental point generation
+    double tile_cache_source[TILE_CACHE_SOURCE_SIZE] = {};  //<! Values the points in tile_cache depend on, besides the depth
 
     moodycamel::BlockingReaderWriterQueue<std::shared_ptr<ob::FrameSet>> captured_frame_queue;
-    moodycamel::BlockingReaderWriterQueue<std::shared_ptr<ob::FrameSet>> processing_frame_queue;
+    /// A captured frameset waiting for the processing thread.
+    struct QueuedFrame {
+        uint64_t sequence;
+        std::shared_ptr<ob::FrameSet> frameset;
+    };
+    enum QueuePolicy {
+        ORBBEC_QUEUE_DROP_NEWEST,   //<! Drop the frame that does not fit
+        ORBBEC_QUEUE_DROP_OLDEST,   //<! Drop the oldest queued frame to make room
+        ORBBEC_QUEUE_BLOCK          //<! Wait until the processing thread has made room
+    };
+    std::deque<QueuedFrame> processing_queue;  //<! Framesets to be processed, oldest first. Protected by processing_queue_mutex.
+    std::mutex processing_queue_mutex;
+    std::condition_variable processing_queue_cv;  //<! Signals changes to processing_queue (and stopping)
+    int processing_queue_size = 1;  //<! Maximum number of framesets in processing_queue
+    bool processing_task_active = false;  //<! True while a _process_queued_framesets() task is submitted or running. Protected by processing_queue_mutex.
+    QueuePolicy processing_queue_policy = ORBBEC_QUEUE_DROP_NEWEST;
+    std::atomic<uint64_t> dropped_frame_count{0};  //<! Number of frames dropped because processing_queue was full
     std::shared_ptr<ob::FrameSet> current_captured_frameset;
-    std::shared_ptr<ob::FrameSet> current_processed_frameset;
+    std::shared_ptr<ob::FrameSet> current_processed_frameset;  //<! Frameset of current_pcl_pointcloud. Protected by processing_mutex.
     bool waiting_for_capture = false;           //< Boolean to stop issuing warning messages while paused.
     bool camera_sync_ismaster;
     bool camera_sync_inuse;
-    std::mutex processing_mutex;  //<! Exclusive lock for frame to pointcloud processing.
+    std::mutex processing_mutex;  //<! Lock for handing processed point clouds to the capturer.
     std::condition_variable processing_done_cv; //<! Condition variable signalling pointcloud ready
-    bool processing_done = false;
+    /// A point cloud produced by the processing thread, waiting for wait_for_pointcloud_processed().
+    struct ProcessedFrame {
+        uint64_t sequence = 0;
+        cwipc_pcl_pointcloud pointcloud;
+        std::vector<float> normals;
+        std::shared_ptr<ob::FrameSet> frameset;
+    };
+    std::deque<ProcessedFrame> processed_frames;  //<! Processed point clouds, oldest first. Protected by processing_mutex.
     bool debug = false;
     std::string record_to_file;
     bool uses_recorder = false;
@@ -3,6 +3,7 @@
 #include <string>
 #include <thread>
 #include <condition_variable>
+#include <deque>
 #include <iostream>
 #include <fstream>
 #include <pcl/common/transforms.h>
@@ -10,7 +11,12 @@
 #define CWIPC_DEBUG
 #define CWIPC_DEBUG_THREAD
 #include "cwipc_util/internal/capturers.hpp"
+#include "cwipc_orbbec/api.h"
 #include "OrbbecConfig.hpp"
+#include "OrbbecThreads.hpp"
+#include "OrbbecTripleBuffer.hpp"
+#include "OrbbecVoxelGrid.hpp"
+#include "OrbbecWorkerPool.hpp"
 
 template<class Type_api_camera, class Type_our_camera> class OrbbecBaseCapture : public CwipcBaseCapture {
 public:
@@ -56,10 +62,7 @@ public:
 
     virtual ~OrbbecBaseCapture() {
         _unload_cameras();
-        if (mergedPC) {
-            mergedPC->free();
-            mergedPC = nullptr;
-        }
+        _discard_merged_pointclouds();
     }
 
     virtual bool can_start() override final {
@@ -75,6 +78,27 @@ public:
             _log_warning("start() called but already started");
             return false;
         }
+        std::vector<int> control_cpus;
+        std::vector<int> worker_cpus;
+        if (!_get_thread_cpus("control_cpus", configuration.control_cpus, control_cpus) ||
+            !_get_thread_cpus("worker_cpus", configuration.worker_cpus, worker_cpus)) {
+            return false;
+        }
+        if (configuration.output_ring_order == "newest") {
+            output_ring_in_order = false;
+        } else if (configuration.output_ring_order == "in_order") {
+            output_ring_in_order = true;
+        } else {
+            _log_error("unknown system.output_ring_order " + configuration.output_ring_order);
+            return false;
+        }
+        free_running = configuration.free_running;
+        output_ring_capacity = std::max(1, configuration.output_ring_size);
+        // The worker pool does all per-camera processing. It is shared with other capturers in this process,
+        // so if one of those started it first the thread count cannot be changed any more.
+        if (!OrbbecWorkerPool::set_thread_count(configuration.worker_threads)) {
+            _log_warning("system.worker_threads ignored: worker pool already running with " + std::to_string(OrbbecWorkerPool::instance().concurrency() - 1) + " threads");
+        }
         //
         // Initialize hardware capture setting (for all cameras)
         //
@@ -106,13 +130,59 @@ public:
         stopped = false;
         control_thread = new std::thread(&OrbbecBaseCapture::_control_thread_main, this);
         _cwipc_setThreadName(control_thread, L"cwipc_orbbec::control_thread");
+        _set_thread_policy(control_thread, "control_thread", control_cpus, configuration.control_priority);
+        if (configuration.frames_in_flight > 1) {
+            merge_thread = new std::thread(&OrbbecBaseCapture::_merge_thread_main, this);
+            _cwipc_setThreadName(merge_thread, L"cwipc_orbbec::merge_thread");
+            _set_thread_policy(merge_thread, "merge_thread", control_cpus, configuration.control_priority);
+        }
+        if (!worker_cpus.empty() || configuration.worker_priority != 0) {
+            // Shared with other capturers in this process: the last one to start wins.
+            std::string error;
+            if (!OrbbecWorkerPool::instance().set_thread_policy(worker_cpus, configuration.worker_priority, error)) {
+                _log_warning("cannot set cpus or priority of worker threads: " + error);
+            }
+        }
         return true;
     }
 
+    /// Parse CPU list setting name. If it is empty and system.numa_node is set, use the CPUs of that node.
+    bool _get_thread_cpus(const std::string& name, const std::string& list, std::vector<int>& cpus) {
+        if (!orbbec_parse_cpu_list(list, cpus)) {
+            _log_error("system." + name + ": malformed cpu list \"" + list + "\"");
+            return false;
+        }
+        if (cpus.empty() && configuration.numa_node >= 0 && !orbbec_numa_node_cpus(configuration.numa_node, cpus)) {
+            _log_warning("system.numa_node " + std::to_string(configuration.numa_node) + " not found, threads not restricted");
+        }
+        return true;
+    }
+
+    /// Apply the CPU and priority settings to one of our threads. Failure (usually lack of privileges) is not fatal.
+    void _set_thread_policy(std::thread* thread, const std::string& name, const std::vector<int>& cpus, int priority) {
+        if (cpus.empty() && priority == 0) return;
+        std::string error;
+        if (!orbbec_set_thread_policy(thread, cpus, priority, error)) {
+            _log_warning("cannot set cpus or priority of " + name + ": " + error);
+        }
+    }
+
     virtual void stop() override final {
+        if (_on_capture_thread()) {
+            // Stopping joins the capture threads, and a thread cannot join itself.
+            _log_error("stop: cannot be called from the point cloud callback");
+            return;
+        }
         _unload_cameras();
     }   
 
+    /// True if the current thread is the control thread or the merge thread (which run the point cloud callback).
+    bool _on_capture_thread() {
+        std::thread::id self = std::this_thread::get_id();
+        return (control_thread != nullptr && control_thread->get_id() == self) ||
+            (merge_thread != nullptr && merge_thread->get_id() == self);
+    }
+
     virtual int get_camera_count() override final { 
         return cameras.size(); 
     }
@@ -178,16 +248,23 @@ public:
             std::this_thread::sleep_for(std::chrono::seconds(1));
             return false;
         }
+        if (has_pointcloud_callback) {
+            return false;
+        }
         _request_new_pointcloud();
         std::this_thread::yield();
         if(configuration.debug) _log_debug_thread("02. available: wait for fresh");
+        if (_merged_available() || !wait) {
+            return _merged_available();
+        }
+        // The mutex is only used for sleeping: the control thread never holds it while it works.
         std::unique_lock<std::mutex> mylock(mergedPC_mutex);
-        auto duration = std::chrono::seconds(wait ? 1 : 0);
-        mergedPC_is_fresh_cv.wait_for(mylock, duration, [this] {
-            return mergedPC_is_fresh;
+        mergedPC_is_fresh_cv.wait_for(mylock, std::chrono::seconds(1), [this] {
+            return _merged_available() || has_pointcloud_callback;
         });
-        if(configuration.debug) _log_debug_thread("03. available: wait for fresh returned " + std::to_string(mergedPC_is_fresh));
-        return mergedPC_is_fresh;
+        bool fresh = _merged_available() && !has_pointcloud_callback;
+        if(configuration.debug) _log_debug_thread("03. available: wait for fresh returned " + std::to_string(fresh));
+        return fresh;
     }
 
     virtual cwipc_pointcloud* get_pointcloud() override final {
@@ -195,28 +272,31 @@ public:
             _log_error("get_pointcloud: not playing");
             return nullptr;
         }
+        if (has_pointcloud_callback) {
+            _log_warning("get_pointcloud: returning NULL, point clouds go to the callback");
+            return nullptr;
+        }
         _request_new_pointcloud();
-        // Wait for a fresh mergedPC to become available.
-        // Note we keep the return value while holding the lock, so we can start the next grab/process/merge cycle before returning.
-        cwipc_pointcloud* rv;
-
-        {
+        // Wait for a fresh merged point cloud to become available, and take it.
+        // When free running there usually is one already, so we return immediately.
+        if (!_merged_available()) {
             if(configuration.debug) _log_debug_thread("02. get_pointcloud: wait for fresh");
             std::unique_lock<std::mutex> mylock(mergedPC_mutex);
             mergedPC_is_fresh_cv.wait(mylock, [this] {
-                return mergedPC_is_fresh;
+                return _merged_available() || stopped || has_pointcloud_callback;
             });
-            if(configuration.debug) _log_debug_thread("03. get_pointcloud: wait for fresh returned " + std::to_string(mergedPC_is_fresh));
-
-            assert(mergedPC_is_fresh);
-            mergedPC_is_fresh = false;
+            if(configuration.debug) _log_debug_thread("03. get_pointcloud: wait for fresh returned " + std::to_string(_merged_available()));
+        }
+        if (has_pointcloud_callback) {
+            // A callback was registered while we were waiting.
+            _log_warning("get_pointcloud: returning NULL, point clouds go to the callback");
+            return nullptr;
+        }
+        cwipc_pointcloud* rv = _take_merged_pointcloud();
+        if (rv == nullptr) {
+            _log_warning("get_pointcloud: returning NULL, capturer stopped");
+        } else {
             numberOfPCsProduced++;
-            rv = mergedPC;
-            mergedPC = nullptr;
-
-            if (rv == nullptr) {
-                _log_warning("get_pointcloud: returning NULL, even though mergedPC_is_fresh");
-            }
         }
 
         _request_new_pointcloud();
@@ -261,6 +341,55 @@ public:
         return true;
     }
 
+    /// Register a callback that gets every merged point cloud (and ownership of it) as soon as it is ready,
+    /// in stead of it being available through get_pointcloud(). nullptr unregisters. After this returns
+    /// the previous callback is no longer running and will not be called again.
+    /// While a callback is registered get_pointcloud() returns nullptr (waking up any thread waiting in it).
+    /// Returns false (and changes nothing) when called from the callback itself.
+    bool set_pointcloud_callback(cwipc_orbbec_pointcloud_callback callback, void* user_data) {
+        if (_on_capture_thread()) {
+            // The callback runs with pointcloud_callback_mutex held.
+            _log_error("set_pointcloud_callback: cannot be called from the point cloud callback");
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> mylock(pointcloud_callback_mutex);
+            pointcloud_callback = callback;
+            pointcloud_callback_data = user_data;
+        }
+        {
+            std::lock_guard<std::mutex> mylock(mergedPC_mutex);
+            has_pointcloud_callback = callback != nullptr;
+        }
+        if (callback != nullptr) {
+            // Point clouds merged before the callback was registered would otherwise be returned (stale) by
+            // the first get_pointcloud() after unregistering.
+            _discard_merged_pointclouds();
+        }
+        mergedPC_want_new_cv.notify_all();
+        mergedPC_is_fresh_cv.notify_all();
+        return true;
+    }
+
+    /// Get the number of frames each camera dropped because its processing queue was full.
+    /// counts must have room for ncount values; returns false if that is less than the number of cameras.
+    bool get_dropped_frames(uint64_t* counts, size_t ncount) {
+        if (ncount < cameras.size()) return false;
+        for (size_t i = 0; i < ncount; i++) {
+            counts[i] = i < cameras.size() ? cameras[i]->get_dropped_frame_count() : 0;
+        }
+        return true;
+    }
+
+    /// Have all cameras learn the background from the next nframes frames (0: forget the background,
+    /// negative: the default, see OrbbecBaseCamera::learn_background()).
+    bool learn_background(int nframes) {
+        for (auto cam : cameras) {
+            cam->learn_background(nframes);
+        }
+        return true;
+    }
+
     bool eof() override {
         return _eof;
     }
@@ -394,14 +523,12 @@ protected:
 
     virtual void _stop_cameras() override final {
         if (configuration.debug) _log_debug_thread("stopping control thread");
-        stopped = true;
-        mergedPC_is_fresh = true;
-        mergedPC_want_new = false;
-
-        mergedPC_is_fresh_cv.notify_all();
-
-        mergedPC_want_new = true;
-        mergedPC_want_new_cv.notify_all();
+        {
+            std::lock_guard<std::mutex> mylock(mergedPC_mutex);
+            stopped = true;
+            mergedPC_want_new = true;
+        }
+        _wake_up_waiting_threads();
 
         if (control_thread && control_thread->joinable()) {
             control_thread->join();
@@ -415,8 +542,20 @@ protected:
         for (auto cam : cameras) {
             cam->stop_camera();
         }
+        // Only now can the merge thread stop: it may be waiting for a camera.
+        _wake_up_waiting_threads();
+        if (merge_thread && merge_thread->joinable()) {
+            merge_thread->join();
+        }
+        delete merge_thread;
+        merge_thread = nullptr;
+        for (auto& frame : pipeline_frames) {
+            frame.pc->free();
+        }
+        pipeline_frames.clear();
+        // Nobody can get these any more, and a restart must not return point clouds from before the stop.
+        _discard_merged_pointclouds();
 
-        mergedPC_is_fresh = false;
         mergedPC_want_new = false;
         _post_stop_all_cameras();
         if (configuration.debug) _log_debug("post-stopped");
@@ -439,11 +578,18 @@ protected:
     void _control_thread_main() {
         if (configuration.debug) _log_debug("control thread started");
         _initial_camera_synchronization();
+        bool pipelined = merge_thread != nullptr;
         while (!stopped) {
             if(configuration.debug) _log_debug_thread("1. wait for mergedPC_want_new");
             {
                 std::unique_lock<std::mutex> mylock(mergedPC_mutex);
-                mergedPC_want_new_cv.wait(mylock, [this] { return mergedPC_want_new; });
+                // With a callback registered, or when free running, we produce point clouds continuously, nobody asks for them.
+                mergedPC_want_new_cv.wait(mylock, [this] { return mergedPC_want_new || has_pointcloud_callback || free_running; });
+            }
+            if (pipelined) {
+                // Capture ahead while the merge thread is still busy with earlier frames, but never more than frames_in_flight.
+                std::unique_lock<std::mutex> mylock(pipeline_mutex);
+                pipeline_cv.wait(mylock, [this] { return stopped || (int)pipeline_frames.size() < configuration.frames_in_flight; });
             }
             //check EOF:
             for (auto cam : cameras) {
@@ -494,56 +640,109 @@ protected:
             }
             if(configuration.debug) _log_debug_thread("4. all cameras->process_pointcloud_from_frameset()");
             // Step 3: start processing frames to pointclouds, for each camera
+            uint64_t sequence = ++frame_sequence;
             for (auto cam : cameras) {
-                cam->process_pointcloud_from_frameset();
+                cam->process_pointcloud_from_frameset(sequence);
             }
 
             if (stopped) {
                 newPC->free();
                 break;
             }
-            if(configuration.debug) _log_debug_thread("5. wait  for mergedpc_mutex");
-            // Lock mergedPC already while we are waiting for the per-camera
-            // processing threads. This so the main thread doesn't go off and do
-            // useless things if it is calling available(true).
-            std::unique_lock<std::mutex> mylock(mergedPC_mutex);
-            if (mergedPC && mergedPC_is_fresh) {
-                mergedPC->free();
-                mergedPC = nullptr;
-            }
-
-            mergedPC = newPC;
-            if (stopped) {
-                break;
+            if (pipelined) {
+                // The merge thread takes it from here. Frames are merged in the order they were captured.
+                {
+                    std::lock_guard<std::mutex> mylock(pipeline_mutex);
+                    pipeline_frames.push_back({sequence, newPC});
+                }
+                pipeline_cv.notify_all();
+                continue;
             }
-
             if(configuration.debug) _log_debug_thread("6. all cameras->wait_for_pointcloud_processed()");
             // Step 4: wait for frame processing to complete.
             for (auto cam : cameras) {
-                cam->wait_for_pointcloud_processed();
+                cam->wait_for_pointcloud_processed(sequence);
             }
 
             if (stopped) {
+                newPC->free();
                 break;
             }
             if(configuration.debug) _log_debug_thread("7. merge_camera_pointclouds()");
             // Step 5: merge views
-            _merge_camera_pointclouds();
+            _merge_camera_pointclouds(newPC);
 
-            if (mergedPC->access_pcl_pointcloud()->size() > 0) {
-                if(configuration.debug) _log_debug("merged pointcloud has  " + std::to_string(mergedPC->access_pcl_pointcloud()->size()) + " points");
+            if (newPC->access_pcl_pointcloud()->size() > 0) {
+                if(configuration.debug) _log_debug("merged pointcloud has  " + std::to_string(newPC->access_pcl_pointcloud()->size()) + " points");
             } else {
                 _log_warning("merged pointcloud is empty");
             }
             if(configuration.debug) _log_debug_thread("8. notify merged_pc_is_fresh. All done.");
-            // Signal that a new mergedPC is available. (Note that we acquired the mutex earlier)
-            mergedPC_is_fresh = true;
-            mergedPC_want_new = false;
-            mergedPC_is_fresh_cv.notify_all();
+            _publish_merged_pointcloud(newPC);
         }
+        // We may have stopped because of end of file: the merge thread and consumers must notice.
+        _wake_up_waiting_threads();
         if (configuration.debug) _log_debug_thread("control thread exiting");
     }
 
+    /// Wake up every thread that may be waiting for something, after stopped has been set: consumers
+    /// waiting for a point cloud, the control thread waiting for a request or for room in the pipeline,
+    /// the merge thread waiting for a frame and the control or merge thread waiting for room in the output ring.
+    /// Taking each mutex (briefly) ensures no thread is between testing stopped and going to sleep.
+    void _wake_up_waiting_threads() {
+        {
+            std::lock_guard<std::mutex> mylock(mergedPC_mutex);
+        }
+        {
+            std::lock_guard<std::mutex> mylock(pipeline_mutex);
+        }
+        mergedPC_is_fresh_cv.notify_all();
+        mergedPC_want_new_cv.notify_all();
+        output_ring_space_cv.notify_all();
+        pipeline_cv.notify_all();
+    }
+
+    /// Second half of the pipeline when frames_in_flight > 1: wait for the cameras to finish processing
+    /// the oldest frame in flight, merge it and publish it. Runs concurrently with the
+    /// control thread capturing the next frames and the cameras processing them.
+    void _merge_thread_main() {
+        if (configuration.debug) _log_debug_thread("merge thread started");
+        while (true) {
+            PipelineFrame frame;
+            {
+                std::unique_lock<std::mutex> mylock(pipeline_mutex);
+                pipeline_cv.wait(mylock, [this] { return stopped || !pipeline_frames.empty(); });
+                if (pipeline_frames.empty()) break;
+                frame = pipeline_frames.front();
+            }
+            cwipc_pointcloud* newPC = frame.pc;
+            bool all_processed = true;
+            for (auto cam : cameras) {
+                if (!cam->wait_for_pointcloud_processed(frame.sequence)) {
+                    all_processed = false;
+                }
+            }
+            if (all_processed) {
+                _merge_camera_pointclouds(newPC);
+                if (newPC->access_pcl_pointcloud()->size() > 0) {
+                    if(configuration.debug) _log_debug("merged pointcloud has  " + std::to_string(newPC->access_pcl_pointcloud()->size()) + " points");
+                } else {
+                    _log_warning("merged pointcloud is empty");
+                }
+                _publish_merged_pointcloud(newPC);
+            } else {
+                // A camera was stopped.
+                newPC->free();
+            }
+            {
+                std::lock_guard<std::mutex> mylock(pipeline_mutex);
+                pipeline_frames.pop_front();
+            }
+            pipeline_cv.notify_all();
+        }
+        if (configuration.debug) _log_debug_thread("merge thread exiting");
+    }
+
 
     bool _capture_all_cameras(uint64_t& timestamp) {
         // xxxjack does not take master into account
@@ -574,18 +773,136 @@ protected:
     }
 
 
+    /// Hand a merged point cloud to the consumer. If the consumer has not taken the previous one it is
+    /// replaced (and freed): the consumer always gets the newest.
+    /// If a callback is registered the point cloud goes to the callback in stead.
+    void _publish_merged_pointcloud(cwipc_pointcloud* pc) {
+        if (has_pointcloud_callback) {
+            std::lock_guard<std::mutex> mylock(pointcloud_callback_mutex);
+            if (pointcloud_callback != nullptr) {
+                numberOfPCsProduced++;
+                pointcloud_callback(pc, pointcloud_callback_data);
+                return;
+            }
+        }
+        if (free_running) {
+            _push_output_ring(pc);
+            return;
+        }
+        cwipc_pointcloud* replaced = merged_buffer.publish(pc);
+        if (replaced) {
+            replaced->free();
+        }
+        {
+            // Taking the mutex (briefly) ensures a consumer that just found nothing available is waiting before we notify.
+            std::lock_guard<std::mutex> mylock(mergedPC_mutex);
+            mergedPC_want_new = false;
+        }
+        mergedPC_is_fresh_cv.notify_all();
+    }
+
+    /// Free running: append pc to the output ring. If the ring is full we either drop the oldest
+    /// point cloud or, if the consumer wants them all in order, wait until it has taken one.
+    void _push_output_ring(cwipc_pointcloud* pc) {
+        cwipc_pointcloud* dropped = nullptr;
+        {
+            std::unique_lock<std::mutex> mylock(mergedPC_mutex);
+            if (output_ring_in_order) {
+                // When stopping we go over capacity (by at most frames_in_flight) in stead of losing the tail of a recording.
+                output_ring_space_cv.wait(mylock, [this] { return output_ring.size() < output_ring_capacity || stopped; });
+            } else if (output_ring.size() >= output_ring_capacity) {
+                dropped = output_ring.front();
+                output_ring.pop_front();
+            }
+            output_ring.push_back(pc);
+            output_ring_count = output_ring.size();
+        }
+        mergedPC_is_fresh_cv.notify_all();
+        if (dropped) {
+            if (configuration.debug) _log_debug("output ring full, dropped oldest point cloud");
+            dropped->free();
+        }
+    }
+
+    /// True if there is a merged point cloud the consumer has not taken yet. Does not need mergedPC_mutex.
+    bool _merged_available() {
+        if (free_running) {
+            return output_ring_count > 0;
+        }
+        return merged_buffer.available();
+    }
+
+    /// Take a merged point cloud for the consumer, or nullptr if there is none. When free running
+    /// this is the oldest one for output_ring_order "in_order", otherwise the newest (older ones are freed).
+    cwipc_pointcloud* _take_merged_pointcloud() {
+        if (!free_running) {
+            // merged_buffer allows only a single consumer, but get_pointcloud() may be called from several threads.
+            std::lock_guard<std::mutex> mylock(merged_consumer_mutex);
+            return merged_buffer.take();
+        }
+        cwipc_pointcloud* rv = nullptr;
+        std::deque<cwipc_pointcloud*> stale;
+        {
+            std::lock_guard<std::mutex> mylock(mergedPC_mutex);
+            if (output_ring.empty()) {
+                return nullptr;
+            }
+            if (output_ring_in_order) {
+                rv = output_ring.front();
+                output_ring.pop_front();
+            } else {
+                rv = output_ring.back();
+                output_ring.pop_back();
+                stale.swap(output_ring);
+            }
+            output_ring_count = output_ring.size();
+        }
+        output_ring_space_cv.notify_all();
+        for (auto stalePC : stale) {
+            stalePC->free();
+        }
+        return rv;
+    }
+
+    /// Free all merged point clouds the consumer has not taken yet.
+    void _discard_merged_pointclouds() {
+        cwipc_pointcloud* pc;
+        {
+            std::lock_guard<std::mutex> mylock(merged_consumer_mutex);
+            pc = merged_buffer.take();
+        }
+        if (pc) {
+            pc->free();
+        }
+        std::deque<cwipc_pointcloud*> stale;
+        {
+            std::lock_guard<std::mutex> mylock(mergedPC_mutex);
+            stale.swap(output_ring);
+            output_ring_count = 0;
+        }
+        output_ring_space_cv.notify_all();
+        for (auto stalePC : stale) {
+            stalePC->free();
+        }
+    }
+
     void _request_new_pointcloud() {
+        if (free_running) {
+            // The control thread does not wait for requests.
+            return;
+        }
         std::unique_lock<std::mutex> mylock(mergedPC_mutex);
 
-        if (!mergedPC_want_new && !mergedPC_is_fresh) {
+        if (!mergedPC_want_new && !merged_buffer.available()) {
             if(configuration.debug) _log_debug_thread("00. request new pointcloud");
             mergedPC_want_new = true;
             mergedPC_want_new_cv.notify_all();
         }
     }
 
-    void _merge_camera_pointclouds() {
-        cwipc_pcl_pointcloud aligned_cld(mergedPC->access_pcl_pointcloud());
+    /// Merge the current point clouds of all cameras into pc.
+    void _merge_camera_pointclouds(cwipc_pointcloud* pc) {
+        cwipc_pcl_pointcloud aligned_cld(pc->access_pcl_pointcloud());
         aligned_cld->clear();
         // Pre-allocate space in the merged pointcloud
         size_t nPoints = 0;
@@ -601,6 +918,10 @@ protected:
         }
 
         aligned_cld->reserve(nPoints);
+        if (configuration.processing.merge_voxel_size > 0 && cameras.size() > 1) {
+            _merge_camera_pointclouds_deduplicated(pc, aligned_cld, nPoints);
+            return;
+        }
 
         // Now merge all pointclouds
         for (auto cam : cameras) {
@@ -615,29 +936,128 @@ protected:
         if (aligned_cld->size() != nPoints) {
             _log_error("Combined pointcloud has different number of points than expected");
         }
+        if (metadata.want_normals) {
+            merged_normals.clear();
+            for (auto cam : cameras) {
+                _append_camera_normals(cam, SIZE_MAX);
+            }
+            _save_merged_normals(pc);
+        }
 
-        // No need to merge metadata: already inserted into mergedPC by each camera
+        // No need to merge metadata: already inserted into the point cloud by each camera
+    }
+
+    /// Append the normals of point p of a camera (or of all its points if p is SIZE_MAX) to merged_normals.
+    /// If the camera has no normals for its point cloud, zero vectors are appended.
+    void _append_camera_normals(Type_our_camera* cam, size_t p) {
+        cwipc_pcl_pointcloud cam_cld = cam->access_current_pcl_pointcloud();
+        if (cam_cld == NULL) return;
+        const std::vector<float>& normals = cam->access_current_normals();
+        bool valid = normals.size() == 3 * cam_cld->size();
+        size_t first = p == SIZE_MAX ? 0 : p;
+        size_t end = p == SIZE_MAX ? cam_cld->size() : p + 1;
+        if (valid) {
+            merged_normals.insert(merged_normals.end(), normals.begin() + 3 * first, normals.begin() + 3 * end);
+        } else {
+            merged_normals.insert(merged_normals.end(), 3 * (end - first), 0.0f);
+        }
+    }
+
+    /// Add merged_normals to pc as "normals" metadata: 3 floats per point, in world coordinates.
+    void _save_merged_normals(cwipc_pointcloud* pc) {
+        size_t count = merged_normals.size() / 3;
+        size_t size = merged_normals.size() * sizeof(float);
+        std::string description =
+            "count=" + std::to_string(count) +
+            ",format=float3" +
+            ",coordinates=world";
+        void* pointer = malloc(size > 0 ? size : 1);
+        if (pointer) {
+            memcpy(pointer, merged_normals.data(), size);
+            cwipc_metadata* ap = pc->access_metadata();
+            ap->_add("normals", description, pointer, size, ::free);
+        }
+    }
+
+    /// Merge, but drop points in voxels that another camera (closer to that voxel) also has points in.
+    void _merge_camera_pointclouds_deduplicated(cwipc_pointcloud* pc, cwipc_pcl_pointcloud aligned_cld, size_t nPoints) {
+        deduplicator.begin((float)configuration.processing.merge_voxel_size, nPoints);
+        merged_normals.clear();
+        for (int i = 0; i < (int)cameras.size(); i++) {
+            cwipc_pcl_pointcloud cam_cld = cameras[i]->access_current_pcl_pointcloud();
+            float position[3];
+            cameras[i]->get_world_position(position);
+            if (cam_cld == NULL) {
+                deduplicator.add(i, position, nullptr, 0);
+                continue;
+            }
+            deduplicator.add(i, position, cam_cld->points.data(), cam_cld->size());
+        }
+        for (int i = 0; i < (int)cameras.size(); i++) {
+            cwipc_pcl_pointcloud cam_cld = cameras[i]->access_current_pcl_pointcloud();
+            if (cam_cld == NULL) {
+                continue;
+            }
+            for (size_t p = 0; p < cam_cld->size(); p++) {
+                if (deduplicator.keep(i, p)) {
+                    aligned_cld->push_back(cam_cld->points[p]);
+                    if (metadata.want_normals) _append_camera_normals(cameras[i], p);
+                }
+            }
+        }
+        if (metadata.want_normals) {
+            _save_merged_normals(pc);
+        }
+        if (deduplicator.out_of_range() > 0) {
+            _log_warning("merge_voxel_size: " + std::to_string(deduplicator.out_of_range()) + " points too far from the origin, not deduplicated");
+        }
+        if (configuration.debug) _log_debug("deduplication kept " + std::to_string(aligned_cld->size()) + " of " + std::to_string(nPoints) + " points");
     }    
 public:
     OrbbecCaptureConfig configuration;
     OrbbecCaptureMetadataConfig metadata;
 protected:
     std::vector<Type_our_camera*> cameras;
+    std::vector<float> merged_normals;  //<! Normals of the merged point cloud, when normals metadata is requested
+    OrbbecVoxelDeduplicator deduplicator;  //<! Used by _merge_camera_pointclouds_deduplicated(), reused every merge
     bool _is_initialized = false;
-    bool stopped = false;
+    std::atomic<bool> stopped{false};  //<! Set when stopping (or at end of file). Threads waiting for it are woken by _wake_up_waiting_threads()
     bool _eof = false;
 
     uint64_t starttime = 0;
-    int numberOfPCsProduced = 0;
+    std::atomic<int> numberOfPCsProduced{0};  //<! Incremented by get_pointcloud() on API threads and by the callback path on the capture threads
 
-    cwipc_pointcloud* mergedPC = nullptr;
-    std::mutex mergedPC_mutex;
+    OrbbecTripleBuffer<cwipc_pointcloud*> merged_buffer;  //<! Merged point clouds, from the control (or merge) thread to the consumer
+    std::mutex merged_consumer_mutex;  //<! Makes consumers take from merged_buffer one at a time
+    std::mutex mergedPC_mutex;  //<! Protects mergedPC_want_new and output_ring, and for sleeping on the condition variables. Never held while working.
 
-    bool mergedPC_is_fresh = false;
-    std::condition_variable mergedPC_is_fresh_cv;
+    std::condition_variable mergedPC_is_fresh_cv;  //<! Signals a new point cloud in merged_buffer
 
     bool mergedPC_want_new = false;
     std::condition_variable mergedPC_want_new_cv;
 
+    bool free_running = false;  //<! Copy of system.free_running: capture continuously into output_ring
+    bool output_ring_in_order = false;  //<! system.output_ring_order is "in_order"
+    size_t output_ring_capacity = 1;  //<! system.output_ring_size
+    std::deque<cwipc_pointcloud*> output_ring;  //<! Merged point clouds when free running, oldest first. Protected by mergedPC_mutex.
+    std::atomic<size_t> output_ring_count{0};  //<! output_ring.size(), readable without the mutex
+    std::condition_variable output_ring_space_cv;  //<! Signals the consumer took a point cloud from output_ring
+
+    std::mutex pointcloud_callback_mutex;  //<! Held while the callback runs, so unregistering waits for it
+    cwipc_orbbec_pointcloud_callback pointcloud_callback = nullptr;  //<! Gets merged point clouds, if not nullptr
+    void* pointcloud_callback_data = nullptr;  //<! Passed to pointcloud_callback
+    std::atomic<bool> has_pointcloud_callback{false};  //<! pointcloud_callback != nullptr, readable without the mutex
+
     std::thread* control_thread = 0;
+    std::thread* merge_thread = nullptr;  //<! Merges and publishes point clouds when frames_in_flight > 1
+
+    uint64_t frame_sequence = 0;  //<! Sequence number of the last frame handed to the cameras
+    /// A frame in flight: its sequence number and the point cloud it will be merged into.
+    struct PipelineFrame {
+        uint64_t sequence = 0;
+        cwipc_pointcloud* pc = nullptr;
+    };
+    std::deque<PipelineFrame> pipeline_frames;  //<! Frames in flight (captured but not yet published), oldest first
+    std::mutex pipeline_mutex;  //<! Protects pipeline_frames
+    std::condition_variable pipeline_cv;  //<! Signals changes to pipeline_frames (and stopping)
 };
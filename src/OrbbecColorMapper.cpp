@@ -0,0 +1,208 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "OrbbecColorMapper.hpp"
+#include "OrbbecDeprojector.hpp"
+
+/// A depth pixel is hidden if it is this much (relative) further from the color camera than the nearest one in its z-buffer cell.
+static const float OCCLUSION_TOLERANCE = 0.02f;
+
+/// Scale intrinsics that may be for another resolution (with the same field of view) to this image size.
+static void _scaled_intrinsic(const OBCameraIntrinsic& intrinsic, int width, int height, double& fx, double& fy, double& cx, double& cy) {
+    double scale_x = 1.0;
+    double scale_y = 1.0;
+    if (intrinsic.width > 0 && intrinsic.height > 0) {
+        scale_x = (double)width / intrinsic.width;
+        scale_y = (double)height / intrinsic.height;
+    }
+    fx = intrinsic.fx * scale_x;
+    fy = intrinsic.fy * scale_y;
+    cx = intrinsic.cx * scale_x;
+    cy = intrinsic.cy * scale_y;
+}
+
+static uint32_t _float_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float _bits_float(uint32_t bits) {
+    float value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+bool OrbbecColorMapper::prepare(
+    const OBCameraIntrinsic& depth_intrinsic, const OBCameraDistortion& depth_distortion, int _depth_width, int _depth_height,
+    const OBCameraIntrinsic& color_intrinsic, const OBCameraDistortion& color_distortion, int _color_width, int _color_height,
+    const OBExtrinsic& depth_to_color
+) {
+    if (_depth_width == depth_width &&
+        _depth_height == depth_height &&
+        _color_width == color_width &&
+        _color_height == color_height &&
+        memcmp(&depth_intrinsic, &mapped_depth_intrinsic, sizeof(OBCameraIntrinsic)) == 0 &&
+        memcmp(&depth_distortion, &mapped_depth_distortion, sizeof(OBCameraDistortion)) == 0 &&
+        memcmp(&color_intrinsic, &mapped_color_intrinsic, sizeof(OBCameraIntrinsic)) == 0 &&
+        memcmp(&color_distortion, &mapped_color_distortion, sizeof(OBCameraDistortion)) == 0 &&
+        memcmp(&depth_to_color, &mapped_extrinsic, sizeof(OBExtrinsic)) == 0) {
+        return true;
+    }
+    reset();
+    if (_depth_width <= 0 || _depth_height <= 0 || _color_width <= 0 || _color_height <= 0 ||
+        depth_intrinsic.fx == 0 || depth_intrinsic.fy == 0 || color_intrinsic.fx == 0 || color_intrinsic.fy == 0) {
+        return false;
+    }
+    double dfx, dfy, dcx, dcy;
+    _scaled_intrinsic(depth_intrinsic, _depth_width, _depth_height, dfx, dfy, dcx, dcy);
+    double cfx, cfy, ccx, ccy;
+    _scaled_intrinsic(color_intrinsic, _color_width, _color_height, cfx, cfy, ccx, ccy);
+    // R and t are the depth-to-color rotation and translation. Depth point p is at R p + t = (R ray) d + t
+    // in the color camera. Perspective divide, color lens distortion and color camera matrix follow per pixel.
+    const float* R = depth_to_color.rot;
+    const float* t = depth_to_color.trans;
+    offset[0] = t[0];
+    offset[1] = t[1];
+    offset[2] = t[2];
+    bool depth_distorted = orbbec_has_distortion(depth_distortion);
+    size_t npixel = (size_t)_depth_width * _depth_height;
+    map_x.resize(npixel);
+    map_y.resize(npixel);
+    map_w.resize(npixel);
+    for (int v = 0; v < _depth_height; v++) {
+        for (int u = 0; u < _depth_width; u++) {
+            double ray_x = (u - dcx) / dfx;
+            double ray_y = (v - dcy) / dfy;
+            if (depth_distorted) {
+                orbbec_undistort(depth_distortion, ray_x, ray_y);
+            }
+            size_t idx = (size_t)v * _depth_width + u;
+            map_x[idx] = (float)(R[0] * ray_x + R[1] * ray_y + R[2]);
+            map_y[idx] = (float)(R[3] * ray_x + R[4] * ray_y + R[5]);
+            map_w[idx] = (float)(R[6] * ray_x + R[7] * ray_y + R[8]);
+        }
+    }
+    color_fx = (float)cfx;
+    color_fy = (float)cfy;
+    color_cx = (float)ccx;
+    color_cy = (float)ccy;
+    color_distorted = orbbec_has_distortion(color_distortion);
+    if (color_distorted) {
+        // Nothing beyond the (undistorted) corners of the color image can be in it. Staying inside that radius
+        // (plus a margin) also keeps us away from where the distortion polynomial folds back into the image.
+        double max_r2 = 0;
+        for (int corner = 0; corner < 4; corner++) {
+            double x = (((corner & 1) ? _color_width : 0) - ccx) / cfx;
+            double y = (((corner & 2) ? _color_height : 0) - ccy) / cfy;
+            orbbec_undistort(color_distortion, x, y);
+            max_r2 = std::max(max_r2, x*x + y*y);
+        }
+        color_max_r2 = (float)(max_r2 * 1.2);
+    }
+    // A depth pixel covers about this many color pixels (ignoring the baseline), so z-buffer cells of this
+    // size are hit by every depth pixel of a surface and leave no holes for hidden pixels to show through.
+    zbuffer_cell = std::max(1, (int)std::ceil(std::max(cfx / dfx, cfy / dfy)));
+    zbuffer_width = (_color_width + zbuffer_cell - 1) / zbuffer_cell;
+    zbuffer_height = (_color_height + zbuffer_cell - 1) / zbuffer_cell;
+    zbuffer.reset(new std::atomic<uint32_t>[(size_t)zbuffer_width * zbuffer_height]);
+    pixel_color.resize(npixel);
+    pixel_z.resize(npixel);
+    mapped_depth_intrinsic = depth_intrinsic;
+    mapped_depth_distortion = depth_distortion;
+    mapped_color_intrinsic = color_intrinsic;
+    mapped_color_distortion = color_distortion;
+    mapped_extrinsic = depth_to_color;
+    depth_width = _depth_width;
+    depth_height = _depth_height;
+    color_width = _color_width;
+    color_height = _color_height;
+    return true;
+}
+
+void OrbbecColorMapper::reset() {
+    mapped_depth_intrinsic = {};
+    mapped_depth_distortion = {};
+    mapped_color_intrinsic = {};
+    mapped_color_distortion = {};
+    mapped_extrinsic = {};
+    depth_width = depth_height = color_width = color_height = 0;
+    color_distorted = false;
+    map_x.clear();
+    map_y.clear();
+    map_w.clear();
+    zbuffer.reset();
+    zbuffer_width = zbuffer_height = 0;
+    pixel_color.clear();
+    pixel_z.clear();
+}
+
+void OrbbecColorMapper::begin_frame() {
+    size_t ncell = (size_t)zbuffer_width * zbuffer_height;
+    uint32_t far = _float_bits(INFINITY);
+    for (size_t i = 0; i < ncell; i++) {
+        zbuffer[i].store(far, std::memory_order_relaxed);
+    }
+}
+
+void OrbbecColorMapper::project_rows(const uint16_t* depth, float value_scale, int first_row, int end_row) {
+    // Working in depth units in stead of millimeters only scales the homogeneous vector, so
+    // divide the translation by the value scale in stead of multiplying every depth.
+    float offset_x = offset[0] / value_scale;
+    float offset_y = offset[1] / value_scale;
+    float offset_w = offset[2] / value_scale;
+    float max_x = color_width - 0.5f;
+    float max_y = color_height - 0.5f;
+    for (size_t idx = (size_t)first_row * depth_width; idx < (size_t)end_row * depth_width; idx++) {
+        pixel_color[idx] = -1;
+        float d = (float)depth[idx];
+        float w = map_w[idx] * d + offset_w;
+        if (depth[idx] == 0 || !(w > 0)) continue;
+        float nx = (map_x[idx] * d + offset_x) / w;
+        float ny = (map_y[idx] * d + offset_y) / w;
+        if (color_distorted) {
+            if (!(nx*nx + ny*ny <= color_max_r2)) continue;
+            double x = nx;
+            double y = ny;
+            orbbec_distort(mapped_color_distortion, x, y);
+            nx = (float)x;
+            ny = (float)y;
+        }
+        float px = color_fx * nx + color_cx;
+        float py = color_fy * ny + color_cy;
+        // Check the range before converting: the float can be far outside the int range (or NaN).
+        if (!(px >= -0.5f && px < max_x && py >= -0.5f && py < max_y)) continue;
+        int u = std::min((int)(px + 0.5f), color_width - 1);
+        int v = std::min((int)(py + 0.5f), color_height - 1);
+        pixel_color[idx] = v * color_width + u;
+        pixel_z[idx] = w;
+        // w is positive, so its bits order like its value.
+        std::atomic<uint32_t>& cell = zbuffer[(size_t)(v / zbuffer_cell) * zbuffer_width + u / zbuffer_cell];
+        uint32_t bits = _float_bits(w);
+        uint32_t nearest = cell.load(std::memory_order_relaxed);
+        while (bits < nearest && !cell.compare_exchange_weak(nearest, bits, std::memory_order_relaxed)) {
+        }
+    }
+}
+
+void OrbbecColorMapper::map_rows(const uint16_t* depth, const uint8_t* color, int first_row, int end_row, uint16_t* out_depth, uint8_t* out_color) const {
+    for (size_t idx = (size_t)first_row * depth_width; idx < (size_t)end_row * depth_width; idx++) {
+        int32_t color_idx = pixel_color[idx];
+        bool visible = color_idx >= 0;
+        if (visible) {
+            int u = color_idx % color_width;
+            int v = color_idx / color_width;
+            float nearest = _bits_float(zbuffer[(size_t)(v / zbuffer_cell) * zbuffer_width + u / zbuffer_cell].load(std::memory_order_relaxed));
+            visible = pixel_z[idx] <= nearest * (1 + OCCLUSION_TOLERANCE);
+        }
+        if (!visible) {
+            // No depth, outside the color image or hidden from the color camera: no point.
+            out_depth[idx] = 0;
+            memset(out_color + 4 * idx, 0, 4);
+            continue;
+        }
+        out_depth[idx] = depth[idx];
+        memcpy(out_color + 4 * idx, color + 4 * (size_t)color_idx, 4);
+    }
+}
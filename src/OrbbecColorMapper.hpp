@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "libobsensor/h/ObTypes.h"
+
+/// Software color-to-depth alignment: for every pixel of a native resolution depth image, find
+/// the color pixel that sees the same point.
+/// The ray of every depth pixel (with depth lens distortion removed) is rotated into the color camera
+/// once per stream profile, so projecting depth pixel (u, v) with depth d costs a multiply-add per
+/// coordinate, a perspective divide and applying the color lens distortion.
+/// Depth pixels hidden from the color camera by something closer get no color (and so no point).
+/// This uses a coarse z-buffer on the color image, with cells about the size of a depth pixel, so
+/// mapping a frame takes two passes: begin_frame(), project_rows() for all rows, then map_rows() for all rows.
+class OrbbecColorMapper {
+public:
+    OrbbecColorMapper() {}
+    /// Ensure the mapping is valid for these streams. Cheap if nothing has changed since the previous call.
+    /// Returns false if the intrinsics cannot be used.
+    bool prepare(
+        const OBCameraIntrinsic& depth_intrinsic, const OBCameraDistortion& depth_distortion, int depth_width, int depth_height,
+        const OBCameraIntrinsic& color_intrinsic, const OBCameraDistortion& color_distortion, int color_width, int color_height,
+        const OBExtrinsic& depth_to_color
+    );
+    /// Forget the mapping, so the next prepare() will rebuild it.
+    void reset();
+
+    /// Start mapping a new frame: clear the z-buffer.
+    void begin_frame();
+    /// First pass: find the color pixel for rows [first_row, end_row) of a depth image (with the given
+    /// value scale, in millimeters), and enter them in the z-buffer. Different row ranges can run concurrently.
+    void project_rows(const uint16_t* depth, float value_scale, int first_row, int end_row);
+    /// Second pass, after project_rows() has been done for all rows: store the depth image with pixels
+    /// that have no (visible) color removed in out_depth, and the color of every depth pixel (BGRA) in out_color.
+    void map_rows(const uint16_t* depth, const uint8_t* color, int first_row, int end_row, uint16_t* out_depth, uint8_t* out_color) const;
+
+private:
+    OBCameraIntrinsic mapped_depth_intrinsic = {};  //<! Depth intrinsics the mapping was built for
+    OBCameraDistortion mapped_depth_distortion = {}; //<! Depth lens distortion the mapping was built for
+    OBCameraIntrinsic mapped_color_intrinsic = {};  //<! Color intrinsics the mapping was built for
+    OBCameraDistortion mapped_color_distortion = {}; //<! Color lens distortion the mapping was built for
+    OBExtrinsic mapped_extrinsic = {};              //<! Depth-to-color extrinsics the mapping was built for
+    int depth_width = 0;
+    int depth_height = 0;
+    int color_width = 0;
+    int color_height = 0;
+    float color_fx = 0;         //<! Color fx, scaled to the color image size
+    float color_fy = 0;         //<! Color fy, scaled to the color image size
+    float color_cx = 0;         //<! Color cx, scaled to the color image size
+    float color_cy = 0;         //<! Color cy, scaled to the color image size
+    bool color_distorted = false;   //<! True if the color lens distortion must be applied
+    float color_max_r2 = 0;     //<! Squared radius (undistorted) beyond which nothing is in the color image, so we never distort far outside the calibrated area
+    std::vector<float> map_x;   //<! Depth pixel ray rotated into the color camera, x
+    std::vector<float> map_y;   //<! Depth pixel ray rotated into the color camera, y
+    std::vector<float> map_w;   //<! Depth pixel ray rotated into the color camera, z
+    float offset[3] = {};       //<! Depth-to-color translation (millimeters)
+    int zbuffer_cell = 1;       //<! Size of a z-buffer cell in color pixels
+    int zbuffer_width = 0;
+    int zbuffer_height = 0;
+    std::unique_ptr<std::atomic<uint32_t>[]> zbuffer;  //<! Nearest color camera z per cell, as float bits (which order like the floats, because they are positive)
+    std::vector<int32_t> pixel_color;   //<! Per depth pixel: index of its color pixel, or -1. Filled by project_rows()
+    std::vector<float> pixel_z;         //<! Per depth pixel: color camera z in depth units. Filled by project_rows()
+};
@@ -13,6 +13,18 @@ void OrbbecCaptureConfig::_from_json(const json &json_data) {
     _CWIPC_CONFIG_JSON_GET(system_data, debug, config, debug);
     _CWIPC_CONFIG_JSON_GET(system_data, apiDebug, config, apiDebug);
     _CWIPC_CONFIG_JSON_GET(system_data, new_timestamps, config, new_timestamps);
+    _CWIPC_CONFIG_JSON_GET(system_data, worker_threads, config, worker_threads);
+    _CWIPC_CONFIG_JSON_GET(system_data, control_cpus, config, control_cpus);
+    _CWIPC_CONFIG_JSON_GET(system_data, worker_cpus, config, worker_cpus);
+    _CWIPC_CONFIG_JSON_GET(system_data, control_priority, config, control_priority);
+    _CWIPC_CONFIG_JSON_GET(system_data, worker_priority, config, worker_priority);
+    _CWIPC_CONFIG_JSON_GET(system_data, numa_node, config, numa_node);
+    _CWIPC_CONFIG_JSON_GET(system_data, frames_in_flight, config, frames_in_flight);
+    _CWIPC_CONFIG_JSON_GET(system_data, processing_queue_size, config, processing_queue_size);
+    _CWIPC_CONFIG_JSON_GET(system_data, processing_queue_policy, config, processing_queue_policy);
+    _CWIPC_CONFIG_JSON_GET(system_data, free_running, config, free_running);
+    _CWIPC_CONFIG_JSON_GET(system_data, output_ring_size, config, output_ring_size);
+    _CWIPC_CONFIG_JSON_GET(system_data, output_ring_order, config, output_ring_order);
     if (json_data.contains("sync")) {
         json sync_data = json_data.at("sync");
         _CWIPC_CONFIG_JSON_GET(sync_data, sync_master_serial, sync, sync_master_serial);
@@ -43,6 +55,17 @@ void OrbbecCaptureConfig::_from_json(const json &json_data) {
         _CWIPC_CONFIG_JSON_GET(processing_data, height_min, processing, height_min);
         _CWIPC_CONFIG_JSON_GET(processing_data, height_max, processing, height_max);
         _CWIPC_CONFIG_JSON_GET(processing_data, radius_filter, processing, radius_filter);
+        _CWIPC_CONFIG_JSON_GET(processing_data, flying_pixel_threshold, processing, flying_pixel_threshold);
+        _CWIPC_CONFIG_JSON_GET(processing_data, background_frames, processing, background_frames);
+        _CWIPC_CONFIG_JSON_GET(processing_data, background_tolerance, processing, background_tolerance);
+        _CWIPC_CONFIG_JSON_GET(processing_data, voxel_size, processing, voxel_size);
+        _CWIPC_CONFIG_JSON_GET(processing_data, merge_voxel_size, processing, merge_voxel_size);
+        _CWIPC_CONFIG_JSON_GET(processing_data, decimation, processing, decimation);
+        _CWIPC_CONFIG_JSON_GET(processing_data, decimation_mode, processing, decimation_mode);
+        _CWIPC_CONFIG_JSON_GET(processing_data, incremental_tile_size, processing, incremental_tile_size);
+        _CWIPC_CONFIG_JSON_GET(processing_data, incremental_tolerance, processing, incremental_tolerance);
+        _CWIPC_CONFIG_JSON_GET(processing_data, incremental_color_tolerance, processing, incremental_color_tolerance);
+        _CWIPC_CONFIG_JSON_GET(processing_data, incremental_refresh_frames, processing, incremental_refresh_frames);
     }
     if (json_data.contains("filtering")) {
         json filtering_data = json_data.at("filtering");
@@ -50,6 +73,9 @@ void OrbbecCaptureConfig::_from_json(const json &json_data) {
         _CWIPC_CONFIG_JSON_GET(filtering_data, do_threshold, filtering, do_threshold);
         _CWIPC_CONFIG_JSON_GET(filtering_data, threshold_near, filtering, threshold_near);
         _CWIPC_CONFIG_JSON_GET(filtering_data, threshold_far, filtering, threshold_far);
+        _CWIPC_CONFIG_JSON_GET(filtering_data, do_temporal, filtering, do_temporal);
+        _CWIPC_CONFIG_JSON_GET(filtering_data, temporal_alpha, filtering, temporal_alpha);
+        _CWIPC_CONFIG_JSON_GET(filtering_data, temporal_delta, filtering, temporal_delta);
     }
     json cameras = json_data.at("camera");
     int camera_index = 0;
@@ -96,6 +122,18 @@ void OrbbecCaptureConfig::_to_json(json& json_data, bool for_recording) {
         _CWIPC_CONFIG_JSON_PUT(system_data, record_to_directory, config, record_to_directory);
     }
     _CWIPC_CONFIG_JSON_PUT(system_data, new_timestamps, config, new_timestamps);
+    _CWIPC_CONFIG_JSON_PUT(system_data, worker_threads, config, worker_threads);
+    _CWIPC_CONFIG_JSON_PUT(system_data, control_cpus, config, control_cpus);
+    _CWIPC_CONFIG_JSON_PUT(system_data, worker_cpus, config, worker_cpus);
+    _CWIPC_CONFIG_JSON_PUT(system_data, control_priority, config, control_priority);
+    _CWIPC_CONFIG_JSON_PUT(system_data, worker_priority, config, worker_priority);
+    _CWIPC_CONFIG_JSON_PUT(system_data, numa_node, config, numa_node);
+    _CWIPC_CONFIG_JSON_PUT(system_data, frames_in_flight, config, frames_in_flight);
+    _CWIPC_CONFIG_JSON_PUT(system_data, processing_queue_size, config, processing_queue_size);
+    _CWIPC_CONFIG_JSON_PUT(system_data, processing_queue_policy, config, processing_queue_policy);
+    _CWIPC_CONFIG_JSON_PUT(system_data, free_running, config, free_running);
+    _CWIPC_CONFIG_JSON_PUT(system_data, output_ring_size, config, output_ring_size);
+    _CWIPC_CONFIG_JSON_PUT(system_data, output_ring_order, config, output_ring_order);
     _CWIPC_CONFIG_JSON_PUT(system_data, debug, config, debug);
     _CWIPC_CONFIG_JSON_PUT(system_data, apiDebug, config, apiDebug);
     json_data["system"] = system_data;
@@ -128,12 +166,26 @@ void OrbbecCaptureConfig::_to_json(json& json_data, bool for_recording) {
     _CWIPC_CONFIG_JSON_PUT(processing_data, height_min, processing, height_min);
     _CWIPC_CONFIG_JSON_PUT(processing_data, height_max, processing, height_max);
     _CWIPC_CONFIG_JSON_PUT(processing_data, radius_filter, processing, radius_filter);
+    _CWIPC_CONFIG_JSON_PUT(processing_data, flying_pixel_threshold, processing, flying_pixel_threshold);
+    _CWIPC_CONFIG_JSON_PUT(processing_data, background_frames, processing, background_frames);
+    _CWIPC_CONFIG_JSON_PUT(processing_data, background_tolerance, processing, background_tolerance);
+    _CWIPC_CONFIG_JSON_PUT(processing_data, voxel_size, processing, voxel_size);
+    _CWIPC_CONFIG_JSON_PUT(processing_data, merge_voxel_size, processing, merge_voxel_size);
+    _CWIPC_CONFIG_JSON_PUT(processing_data, decimation, processing, decimation);
+    _CWIPC_CONFIG_JSON_PUT(processing_data, decimation_mode, processing, decimation_mode);
+    _CWIPC_CONFIG_JSON_PUT(processing_data, incremental_tile_size, processing, incremental_tile_size);
+    _CWIPC_CONFIG_JSON_PUT(processing_data, incremental_tolerance, processing, incremental_tolerance);
+    _CWIPC_CONFIG_JSON_PUT(processing_data, incremental_color_tolerance, processing, incremental_color_tolerance);
+    _CWIPC_CONFIG_JSON_PUT(processing_data, incremental_refresh_frames, processing, incremental_refresh_frames);
     json_data["processing"] = processing_data;
     
     json filtering_data;
     _CWIPC_CONFIG_JSON_PUT(filtering_data, do_threshold, filtering, do_threshold);
     _CWIPC_CONFIG_JSON_PUT(filtering_data, threshold_near, filtering, threshold_near);
     _CWIPC_CONFIG_JSON_PUT(filtering_data, threshold_far, filtering, threshold_far);
+    _CWIPC_CONFIG_JSON_PUT(filtering_data, do_temporal, filtering, do_temporal);
+    _CWIPC_CONFIG_JSON_PUT(filtering_data, temporal_alpha, filtering, temporal_alpha);
+    _CWIPC_CONFIG_JSON_PUT(filtering_data, temporal_delta, filtering, temporal_delta);
     _CWIPC_CONFIG_JSON_PUT(filtering_data, map_color_to_depth, filtering, map_color_to_depth);
     json_data["filtering"] = filtering_data;
 
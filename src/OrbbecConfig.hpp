@@ -11,6 +11,9 @@ struct OrbbecCameraProcessingParameters {
     bool do_threshold = true;
     double threshold_near = 0.15;         // float, near point for distance threshold
     double threshold_far = 6.0;           // float, far point for distance threshold
+    bool do_temporal = false;             // If true apply temporal filtering to the depth image
+    double temporal_alpha = 0.4;          // float, weight of the new frame in the temporal filter (1.0 is no smoothing)
+    double temporal_delta = 0.02;         // float, pixels that change more than this (meters) restart the temporal filter
     bool map_color_to_depth = false; // default DEPTH_TO_COLOR
 };
 
@@ -42,6 +45,17 @@ struct OrbbecCaptureProcessingConfig {
     double height_min = 0.0;        // If height_min != height_max perform height filtering
     double height_max = 0.0;        // If height_min != height_max perform height filtering
     double radius_filter = 0.0;     // If radius_filter > 0 we will remove all points further than radius_filter from the (0,1,0) axis
+    double flying_pixel_threshold = 0.0; // If > 0 remove depth pixels that differ from both opposite neighbours by more than this fraction of their depth
+    int background_frames = 0;      // If background_frames > 0 learn the static background from the first background_frames frames (at most 65535). Also the learn_background default (30 if 0)
+    double background_tolerance = 0.05; // Depth pixels not at least this much (meters) in front of the learned background are removed
+    double voxel_size = 0.0;        // If voxel_size > 0 each camera downsamples its points to one point per voxel of this size (meters)
+    double merge_voxel_size = 0.0;  // If merge_voxel_size > 0 points in voxels of this size (meters) that are also seen by a closer camera are dropped when merging
+    int decimation = 1;             // If decimation > 1 each decimation x decimation block of depth pixels produces at most one point
+    std::string decimation_mode = "stride"; // How a block is reduced to one pixel: "stride", "median" or "min" (of the valid depths)
+    int incremental_tile_size = 0;  // If > 0 only regenerate the points of tiles of this size (depth pixels) whose depth or average color changed, reuse the others
+    double incremental_tolerance = 0.01; // Depth changes of at most this much (meters) do not count as a change of a tile.
+    int incremental_color_tolerance = 4; // Changes of the average r, g or b of a tile of at most this much do not count as a change of a tile.
+    int incremental_refresh_frames = 30; // Regenerate a tile at least every this many frames, even if it has not changed. 0 means never.
 };
 
 struct OrbbecCaptureSyncConfig {
@@ -53,6 +67,7 @@ struct OrbbecCaptureSyncConfig {
 struct OrbbecCaptureMetadataConfig {
     bool want_rgb = false;
     bool want_depth = false;
+    bool want_normals = false;  // Compute per-point normals and add them as "normals" metadata
 };
 struct OrbbecCaptureConfig : public CwipcBaseCaptureConfig {
     OrbbecCaptureProcessingConfig processing;
@@ -64,6 +79,18 @@ struct OrbbecCaptureConfig : public CwipcBaseCaptureConfig {
     OrbbecCameraProcessingParameters camera_processing;
     std::string record_to_directory = ""; // If non-empty all camera streams will be recorded to this directory.
     bool new_timestamps = false; // If true new timestamps are generated (otherwise original timestamps from capture time)
+    int worker_threads = 0;     // Number of threads in the worker pool shared by all cameras and capturers. 0 means one less than the number of cores.
+    std::string control_cpus = "";  // CPUs (like "0-3,8") the control and merge threads may run on. Empty means any.
+    std::string worker_cpus = "";   // CPUs the worker pool threads may run on. Empty means any.
+    int control_priority = 0;   // If > 0 give the control and merge threads this real-time priority (1-99)
+    int worker_priority = 0;    // If > 0 give the worker pool threads this real-time priority (1-99)
+    int numa_node = -1;         // If >= 0 threads without explicit CPUs are restricted to the CPUs of this NUMA node
+    int frames_in_flight = 1;   // Number of frames that can be captured, processed and merged concurrently. 1 means strict lockstep.
+    int processing_queue_size = 0; // Number of captured frames each camera can queue for processing. 0 means frames_in_flight.
+    std::string processing_queue_policy = "drop_newest"; // What to do when the processing queue is full: "drop_newest", "drop_oldest" or "block"
+    bool free_running = false;  // If true capture continuously at camera rate into the output ring, in stead of when get() asks for a point cloud
+    int output_ring_size = 4;   // Number of merged point clouds kept for the consumer when free_running
+    std::string output_ring_order = "newest"; // What get() returns when free_running: "newest" (older ones are discarded, the ring drops the oldest when full) or "in_order" (capture waits when the ring is full)
     bool debug = false;
     bool apiDebug = false;
     // We could probably also allow overriding GPU id and model path, but no need for now.
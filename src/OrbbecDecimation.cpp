@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cstring>
+
+#include "OrbbecDecimation.hpp"
+
+bool orbbec_decimation_mode_from_string(const std::string& name, OrbbecDecimationMode& mode) {
+    if (name == "stride") {
+        mode = ORBBEC_DECIMATION_STRIDE;
+    } else if (name == "median") {
+        mode = ORBBEC_DECIMATION_MEDIAN;
+    } else if (name == "min") {
+        mode = ORBBEC_DECIMATION_MIN;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+double orbbec_decimation_sample_offset(OrbbecDecimationMode mode, int factor) {
+    if (mode == ORBBEC_DECIMATION_STRIDE) {
+        // We sample an actual pixel
+        return factor / 2;
+    }
+    // The selected pixel could be anywhere in the block, so use the center.
+    return (factor - 1) / 2.0;
+}
+
+void orbbec_decimate_rows(
+    OrbbecDecimationMode mode,
+    int factor,
+    const uint16_t* depth,
+    const uint8_t* color,
+    int width,
+    int out_width,
+    int first_row,
+    int end_row,
+    uint16_t* out_depth,
+    uint8_t* out_color
+) {
+    // Valid depths in a block, with the index of the pixel within the block in the low byte.
+    uint32_t candidates[ORBBEC_DECIMATION_MAX * ORBBEC_DECIMATION_MAX];
+    for (int v = first_row; v < end_row; v++) {
+        for (int u = 0; u < out_width; u++) {
+            size_t out_idx = (size_t)v * out_width + u;
+            size_t block_idx = (size_t)v * factor * width + (size_t)u * factor;
+            size_t selected_idx;
+            if (mode == ORBBEC_DECIMATION_STRIDE) {
+                selected_idx = block_idx + (size_t)(factor / 2) * width + factor / 2;
+            } else {
+                int ncandidate = 0;
+                for (int dv = 0; dv < factor; dv++) {
+                    const uint16_t* row = depth + block_idx + (size_t)dv * width;
+                    for (int du = 0; du < factor; du++) {
+                        if (row[du] != 0) {
+                            candidates[ncandidate++] = ((uint32_t)row[du] << 8) | (uint32_t)(dv * factor + du);
+                        }
+                    }
+                }
+                if (ncandidate == 0) {
+                    out_depth[out_idx] = 0;
+                    memset(out_color + 4 * out_idx, 0, 4);
+                    continue;
+                }
+                uint32_t selected;
+                if (mode == ORBBEC_DECIMATION_MIN) {
+                    selected = *std::min_element(candidates, candidates + ncandidate);
+                } else {
+                    // Lower median, so we always select an existing pixel.
+                    uint32_t* median = candidates + (ncandidate - 1) / 2;
+                    std::nth_element(candidates, median, candidates + ncandidate);
+                    selected = *median;
+                }
+                int offset = selected & 0xff;
+                selected_idx = block_idx + (size_t)(offset / factor) * width + offset % factor;
+            }
+            out_depth[out_idx] = depth[selected_idx];
+            memcpy(out_color + 4 * out_idx, color + 4 * selected_idx, 4);
+        }
+    }
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+/// How a block of depth pixels is reduced to a single pixel by depth decimation.
+enum OrbbecDecimationMode {
+    ORBBEC_DECIMATION_STRIDE,   //<! Take the pixel in the middle of the block
+    ORBBEC_DECIMATION_MEDIAN,   //<! Take the pixel with the median depth of the valid pixels in the block
+    ORBBEC_DECIMATION_MIN       //<! Take the pixel with the smallest depth of the valid pixels in the block
+};
+
+/// Largest supported processing.decimation factor.
+#define ORBBEC_DECIMATION_MAX 16
+
+/// Parse a processing.decimation_mode string ("stride", "median" or "min"). Returns false if unknown.
+bool orbbec_decimation_mode_from_string(const std::string& name, OrbbecDecimationMode& mode);
+
+/// Position (in full resolution pixels, relative to the top left of the block) of the point a
+/// decimated pixel represents. This is what the rays for the decimated image should be computed for.
+double orbbec_decimation_sample_offset(OrbbecDecimationMode mode, int factor);
+
+/// Reduce each factor x factor block of the depth image to a single pixel, for rows [first_row, end_row)
+/// of the decimated image. The color of a decimated pixel is the color of the depth pixel that was
+/// selected, so depth and color stay consistent. Invalid (zero) depth pixels are ignored by the
+/// median and min modes; a block without valid pixels gives an invalid pixel.
+/// width is the width of the full resolution images, out_width the width of the decimated images.
+void orbbec_decimate_rows(
+    OrbbecDecimationMode mode,
+    int factor,
+    const uint16_t* depth,
+    const uint8_t* color,
+    int width,
+    int out_width,
+    int first_row,
+    int end_row,
+    uint16_t* out_depth,
+    uint8_t* out_color
+);
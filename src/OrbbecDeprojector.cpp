@@ -0,0 +1,244 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "OrbbecDeprojector.hpp"
+
+bool orbbec_has_distortion(const OBCameraDistortion& distortion) {
+    if (distortion.model != OB_DISTORTION_BROWN_CONRADY && distortion.model != OB_DISTORTION_BROWN_CONRADY_K6) {
+        return false;
+    }
+    return distortion.k1 != 0 || distortion.k2 != 0 || distortion.k3 != 0 ||
+        distortion.k4 != 0 || distortion.k5 != 0 || distortion.k6 != 0 ||
+        distortion.p1 != 0 || distortion.p2 != 0;
+}
+
+/// Radial distortion factor for squared radius r2: (1 + k1 r2 + k2 r2^2 + k3 r2^3) / (1 + k4 r2 + k5 r2^2 + k6 r2^3).
+/// The k4-k6 terms are only used for OB_DISTORTION_BROWN_CONRADY_K6.
+static double _radial_factor(const OBCameraDistortion& distortion, double r2) {
+    double numerator = 1 + r2 * (distortion.k1 + r2 * (distortion.k2 + r2 * distortion.k3));
+    double denominator = 1;
+    if (distortion.model == OB_DISTORTION_BROWN_CONRADY_K6) {
+        denominator = 1 + r2 * (distortion.k4 + r2 * (distortion.k5 + r2 * distortion.k6));
+    }
+    return numerator / denominator;
+}
+
+void orbbec_distort(const OBCameraDistortion& distortion, double& x, double& y) {
+    double r2 = x*x + y*y;
+    double radial = _radial_factor(distortion, r2);
+    double xd = x * radial + 2 * distortion.p1 * x * y + distortion.p2 * (r2 + 2 * x*x);
+    double yd = y * radial + distortion.p1 * (r2 + 2 * y*y) + 2 * distortion.p2 * x * y;
+    x = xd;
+    y = yd;
+}
+
+void orbbec_undistort(const OBCameraDistortion& distortion, double& x, double& y) {
+    // Fixed-point iteration, like OpenCV undistortPoints(). Converges quickly for the moderate
+    // distortion of depth and color lenses.
+    const double xd = x;
+    const double yd = y;
+    for (int i = 0; i < 20; i++) {
+        double r2 = x*x + y*y;
+        double radial = _radial_factor(distortion, r2);
+        if (radial <= 0) break;
+        double dx = 2 * distortion.p1 * x * y + distortion.p2 * (r2 + 2 * x*x);
+        double dy = distortion.p1 * (r2 + 2 * y*y) + 2 * distortion.p2 * x * y;
+        x = (xd - dx) / radial;
+        y = (yd - dy) / radial;
+    }
+}
+
+bool OrbbecDeprojector::prepare(const OBCameraIntrinsic& intrinsic, const OBCameraDistortion& distortion, int width, int height, int decimation, double sample_offset) {
+    if (width == table_source_width &&
+        height == table_source_height &&
+        decimation == table_decimation &&
+        sample_offset == table_sample_offset &&
+        intrinsic.fx == table_intrinsic.fx &&
+        intrinsic.fy == table_intrinsic.fy &&
+        intrinsic.cx == table_intrinsic.cx &&
+        intrinsic.cy == table_intrinsic.cy &&
+        intrinsic.width == table_intrinsic.width &&
+        intrinsic.height == table_intrinsic.height &&
+        memcmp(&distortion, &table_distortion, sizeof(OBCameraDistortion)) == 0) {
+        return true;
+    }
+    reset();
+    if (width <= 0 || height <= 0 || decimation <= 0 || intrinsic.fx == 0 || intrinsic.fy == 0) {
+        return false;
+    }
+    int table_w = width / decimation;
+    int table_h = height / decimation;
+    if (table_w <= 0 || table_h <= 0) {
+        return false;
+    }
+    // The intrinsics may be for a different resolution than the image we get
+    // (but with the same field of view). Scale them if needed.
+    double scale_x = 1.0;
+    double scale_y = 1.0;
+    if (intrinsic.width > 0 && intrinsic.height > 0) {
+        scale_x = (double)width / intrinsic.width;
+        scale_y = (double)height / intrinsic.height;
+    }
+    double fx = intrinsic.fx * scale_x;
+    double fy = intrinsic.fy * scale_y;
+    double cx = intrinsic.cx * scale_x;
+    double cy = intrinsic.cy * scale_y;
+
+    bool distorted = orbbec_has_distortion(distortion);
+    ray_x.resize((size_t)table_w * table_h);
+    ray_y.resize((size_t)table_w * table_h);
+    ray_min_x = ray_min_y = INFINITY;
+    ray_max_x = ray_max_y = -INFINITY;
+    for (int v = 0; v < table_h; v++) {
+        float* row_x = ray_x.data() + (size_t)v * table_w;
+        float* row_y = ray_y.data() + (size_t)v * table_w;
+        for (int u = 0; u < table_w; u++) {
+            double x = (u * decimation + sample_offset - cx) / fx;
+            double y = (v * decimation + sample_offset - cy) / fy;
+            if (distorted) {
+                orbbec_undistort(distortion, x, y);
+            }
+            row_x[u] = (float)x;
+            row_y[u] = (float)y;
+            ray_min_x = std::min(ray_min_x, row_x[u]);
+            ray_max_x = std::max(ray_max_x, row_x[u]);
+            ray_min_y = std::min(ray_min_y, row_y[u]);
+            ray_max_y = std::max(ray_max_y, row_y[u]);
+        }
+    }
+    ray_margin = decimation / std::min(fx, fy);
+    table_intrinsic = intrinsic;
+    table_distortion = distortion;
+    table_width = table_w;
+    table_height = table_h;
+    table_source_width = width;
+    table_source_height = height;
+    table_decimation = decimation;
+    table_sample_offset = sample_offset;
+    table_generation++;
+    return true;
+}
+
+void OrbbecDeprojector::reset() {
+    table_intrinsic = {};
+    table_distortion = {};
+    table_width = 0;
+    table_height = 0;
+    table_source_width = 0;
+    table_source_height = 0;
+    table_decimation = 1;
+    table_sample_offset = 0;
+    ray_min_x = ray_max_x = ray_min_y = ray_max_y = 0;
+    ray_margin = 0;
+    ray_x.clear();
+    ray_y.clear();
+}
+
+void OrbbecDeprojector::compute_roi(const Eigen::Affine3d& cam_to_world, const Eigen::Vector3d& world_min, const Eigen::Vector3d& world_max, double z_near, double z_far, OrbbecDepthRoi& roi) const {
+    // Start with everything, and make the region smaller if we can.
+    roi.first_col = 0;
+    roi.end_col = table_width;
+    roi.first_row = 0;
+    roi.end_row = table_height;
+    roi.z_min = z_near;
+    roi.z_max = z_far;
+    if (table_width <= 0 || table_height <= 0 || z_near <= 0 || z_near > z_far) return;
+    //
+    // The volume may be unbounded in some directions. Bound it by the world-space bounding box of
+    // the part of the view frustum between z_near and z_far. With lens distortion the extreme rays
+    // need not be those of the corner pixels, so use the smallest pyramid containing all rays.
+    //
+    Eigen::Vector3d box_min = world_min;
+    Eigen::Vector3d box_max = world_max;
+    Eigen::Vector3d frustum_min = Eigen::Vector3d::Constant(INFINITY);
+    Eigen::Vector3d frustum_max = Eigen::Vector3d::Constant(-INFINITY);
+    for (int corner = 0; corner < 8; corner++) {
+        double rx = (corner & 1) ? ray_max_x : ray_min_x;
+        double ry = (corner & 2) ? ray_max_y : ray_min_y;
+        double z = (corner & 4) ? z_far : z_near;
+        Eigen::Vector3d world = cam_to_world * Eigen::Vector3d(rx * z, ry * z, z);
+        frustum_min = frustum_min.cwiseMin(world);
+        frustum_max = frustum_max.cwiseMax(world);
+    }
+    box_min = box_min.cwiseMax(frustum_min);
+    box_max = box_max.cwiseMin(frustum_max);
+    if ((box_min.array() > box_max.array()).any()) {
+        roi.end_col = roi.end_row = 0;
+        return;
+    }
+    //
+    // Clip the box against the slab z_near <= z <= z_far in camera space. The vertices of the
+    // result are the box corners inside the slab plus the points where box edges cross the slab planes.
+    //
+    Eigen::Affine3d world_to_cam = cam_to_world.inverse();
+    Eigen::Vector3d corners[8];
+    for (int corner = 0; corner < 8; corner++) {
+        Eigen::Vector3d world(
+            (corner & 1) ? box_max.x() : box_min.x(),
+            (corner & 2) ? box_max.y() : box_min.y(),
+            (corner & 4) ? box_max.z() : box_min.z()
+        );
+        corners[corner] = world_to_cam * world;
+    }
+    std::vector<Eigen::Vector3d> vertices;
+    for (int corner = 0; corner < 8; corner++) {
+        if (corners[corner].z() >= z_near && corners[corner].z() <= z_far) {
+            vertices.push_back(corners[corner]);
+        }
+        for (int bit = 1; bit < 8; bit <<= 1) {
+            if (corner & bit) continue;
+            const Eigen::Vector3d& a = corners[corner];
+            const Eigen::Vector3d& b = corners[corner | bit];
+            for (double plane : { z_near, z_far }) {
+                if ((a.z() < plane) == (b.z() < plane) || a.z() == b.z()) continue;
+                double t = (plane - a.z()) / (b.z() - a.z());
+                Eigen::Vector3d crossing = a + t * (b - a);
+                crossing.z() = plane;
+                vertices.push_back(crossing);
+            }
+        }
+    }
+    if (vertices.empty()) {
+        roi.end_col = roi.end_row = 0;
+        return;
+    }
+    //
+    // Project the vertices onto the z=1 plane. The bounding rectangle of the projections contains the
+    // rays of all pixels that can see the volume, so the region is the bounding rectangle of those pixels.
+    // The ray table has lens distortion removed, so this also holds for distorted images.
+    // Add about a pixel on each side to cover rounding.
+    //
+    double x_min = INFINITY, x_max = -INFINITY, y_min = INFINITY, y_max = -INFINITY;
+    double z_min = INFINITY, z_max = -INFINITY;
+    for (const Eigen::Vector3d& p : vertices) {
+        x_min = std::min(x_min, p.x() / p.z());
+        x_max = std::max(x_max, p.x() / p.z());
+        y_min = std::min(y_min, p.y() / p.z());
+        y_max = std::max(y_max, p.y() / p.z());
+        z_min = std::min(z_min, p.z());
+        z_max = std::max(z_max, p.z());
+    }
+    x_min -= ray_margin;
+    x_max += ray_margin;
+    y_min -= ray_margin;
+    y_max += ray_margin;
+    int first_col = table_width, end_col = 0, first_row = table_height, end_row = 0;
+    for (int v = 0; v < table_height; v++) {
+        const float* row_x = ray_x.data() + (size_t)v * table_width;
+        const float* row_y = ray_y.data() + (size_t)v * table_width;
+        for (int u = 0; u < table_width; u++) {
+            if (row_x[u] < x_min || row_x[u] > x_max || row_y[u] < y_min || row_y[u] > y_max) continue;
+            first_col = std::min(first_col, u);
+            end_col = std::max(end_col, u + 1);
+            first_row = std::min(first_row, v);
+            end_row = v + 1;
+        }
+    }
+    roi.first_col = first_col;
+    roi.end_col = end_col;
+    roi.first_row = first_row;
+    roi.end_row = end_row;
+    roi.z_min = z_min;
+    roi.z_max = z_max;
+}
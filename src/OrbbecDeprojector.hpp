@@ -0,0 +1,82 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include <Eigen/Geometry>
+
+#include "libobsensor/h/ObTypes.h"
+
+/// The part of a depth image that can contain points inside some world-space volume.
+struct OrbbecDepthRoi {
+    int first_col = 0;  //<! First column that can contain points
+    int end_col = 0;    //<! One past the last column that can contain points
+    int first_row = 0;  //<! First row that can contain points
+    int end_row = 0;    //<! One past the last row that can contain points
+    double z_min = 0;   //<! Smallest camera-space z (meters) of a point in the volume
+    double z_max = 0;   //<! Largest camera-space z (meters) of a point in the volume
+
+    bool empty() const { return first_col >= end_col || first_row >= end_row || z_min > z_max; }
+};
+
+/// True if distortion is a lens distortion we can handle (Brown-Conrady, with or without the rational
+/// k4-k6 terms) with at least one non-zero coefficient. Other models are treated as no distortion.
+bool orbbec_has_distortion(const OBCameraDistortion& distortion);
+/// Apply lens distortion to normalized image coordinates (x/z, y/z).
+void orbbec_distort(const OBCameraDistortion& distortion, double& x, double& y);
+/// Remove lens distortion from normalized image coordinates. Inverse of orbbec_distort(), by iteration.
+void orbbec_undistort(const OBCameraDistortion& distortion, double& x, double& y);
+
+/// Native replacement for ob::PointCloudFilter.
+/// Holds a ray for every depth pixel, computed once per depth stream profile (with lens distortion removed).
+/// Multiplying the ray by the depth of the pixel gives the camera-space point, so
+/// turning a depth image into points needs no per-frame setup and no intermediate buffer.
+class OrbbecDeprojector {
+public:
+    OrbbecDeprojector() {}
+    /// Ensure the ray table is valid for these intrinsics, this lens distortion and this depth image size.
+    /// If decimation is more than 1 the table is for the decimated image, in which pixel (u, v)
+    /// represents full resolution pixel (u*decimation + sample_offset, v*decimation + sample_offset).
+    /// Cheap if nothing has changed since the previous call.
+    /// Returns false if the intrinsics cannot be used.
+    bool prepare(const OBCameraIntrinsic& intrinsic, const OBCameraDistortion& distortion, int width, int height, int decimation=1, double sample_offset=0);
+    /// Forget the ray table, so the next prepare() will rebuild it.
+    void reset();
+
+    /// Width of the (possibly decimated) image the table is for.
+    int width() const { return table_width; }
+    /// Height of the (possibly decimated) image the table is for.
+    int height() const { return table_height; }
+    /// Incremented every time the ray table is rebuilt, so users can tell when to recompute things derived from it.
+    unsigned int generation() const { return table_generation; }
+    /// x components of the rays, one per pixel, row-major. The z component is always 1.
+    const float* rays_x() const { return ray_x.data(); }
+    /// y components of the rays, one per pixel, row-major. The z component is always 1.
+    const float* rays_y() const { return ray_y.data(); }
+
+    /// Compute a conservative region of interest: the pixels and depths that can see any point
+    /// inside the axis-aligned world-space box [world_min, world_max] (meters, sides may be
+    /// infinite) at camera-space z between z_near and z_far (meters).
+    /// cam_to_world maps camera-space meters to world meters.
+    /// Only valid after a successful prepare().
+    void compute_roi(const Eigen::Affine3d& cam_to_world, const Eigen::Vector3d& world_min, const Eigen::Vector3d& world_max, double z_near, double z_far, OrbbecDepthRoi& roi) const;
+
+private:
+    OBCameraIntrinsic table_intrinsic = {};  //<! Intrinsics the current table was built for
+    OBCameraDistortion table_distortion = {}; //<! Lens distortion the current table was built for
+    int table_width = 0;                     //<! Width of the (decimated) depth image the table was built for
+    int table_height = 0;                    //<! Height of the (decimated) depth image the table was built for
+    int table_source_width = 0;              //<! Width of the full resolution depth image
+    int table_source_height = 0;             //<! Height of the full resolution depth image
+    int table_decimation = 1;                //<! Decimation factor the table was built for
+    double table_sample_offset = 0;          //<! Decimation sample offset the table was built for
+    unsigned int table_generation = 0;       //<! Number of times the table has been rebuilt
+    float ray_min_x = 0;                     //<! Smallest x component of any ray
+    float ray_max_x = 0;                     //<! Largest x component of any ray
+    float ray_min_y = 0;                     //<! Smallest y component of any ray
+    float ray_max_y = 0;                     //<! Largest y component of any ray
+    double ray_margin = 0;                   //<! About one pixel, in ray units, to cover rounding
+    std::vector<float> ray_x;
+    std::vector<float> ray_y;
+};
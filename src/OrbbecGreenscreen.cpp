@@ -0,0 +1,87 @@
+#include <vector>
+
+#include "OrbbecGreenscreen.hpp"
+#include "cwipc_util/internal/capturers.hpp"
+
+static const int LUT_SHIFT = 8 - ORBBEC_GREENSCREEN_LUT_BITS;
+static const int LUT_SIZE = 1 << (3 * ORBBEC_GREENSCREEN_LUT_BITS);
+
+static const int LUT_MASK = (1 << ORBBEC_GREENSCREEN_LUT_BITS) - 1;
+
+/// Classify one cell by running isNotGreen() on its corners, edge and face centres and its centre.
+static uint8_t _classify_cell(int cell) {
+    const int cell_size = 1 << LUT_SHIFT;
+    const int offsets[3] = { 0, cell_size / 2, cell_size - 1 };
+    int r0 = (cell >> (2 * ORBBEC_GREENSCREEN_LUT_BITS)) << LUT_SHIFT;
+    int g0 = ((cell >> ORBBEC_GREENSCREEN_LUT_BITS) & LUT_MASK) << LUT_SHIFT;
+    int b0 = (cell & LUT_MASK) << LUT_SHIFT;
+    int nkeep = 0;
+    int nremove = 0;
+    bool changed = false;
+    for (int dr : offsets) {
+        for (int dg : offsets) {
+            for (int db : offsets) {
+                cwipc_pcl_point pt;
+                pt.r = r0 + dr;
+                pt.g = g0 + dg;
+                pt.b = b0 + db;
+                pt.a = 0;
+                if (isNotGreen(&pt)) {
+                    nkeep++;
+                    if (pt.r != r0 + dr || pt.g != g0 + dg || pt.b != b0 + db) changed = true;
+                } else {
+                    nremove++;
+                }
+            }
+        }
+    }
+    if (nkeep == 0) return ORBBEC_GREENSCREEN_REMOVE;
+    if (nremove == 0 && !changed) return ORBBEC_GREENSCREEN_KEEP;
+    return ORBBEC_GREENSCREEN_CHECK;
+}
+
+static std::vector<uint8_t> _build_lut() {
+    std::vector<uint8_t> sampled(LUT_SIZE);
+    for (int cell = 0; cell < LUT_SIZE; cell++) {
+        sampled[cell] = _classify_cell(cell);
+    }
+    // The samples can miss a boundary that only just enters a cell. So a cell is only decided
+    // by the table if all its neighbours got the same answer too.
+    std::vector<uint8_t> lut(sampled);
+    for (int cell = 0; cell < LUT_SIZE; cell++) {
+        if (sampled[cell] == ORBBEC_GREENSCREEN_CHECK) continue;
+        int rgb[3] = {
+            cell >> (2 * ORBBEC_GREENSCREEN_LUT_BITS),
+            (cell >> ORBBEC_GREENSCREEN_LUT_BITS) & LUT_MASK,
+            cell & LUT_MASK
+        };
+        for (int axis = 0; axis < 3 && lut[cell] != ORBBEC_GREENSCREEN_CHECK; axis++) {
+            int stride = 1 << ((2 - axis) * ORBBEC_GREENSCREEN_LUT_BITS);
+            if ((rgb[axis] > 0 && sampled[cell - stride] != sampled[cell]) ||
+                (rgb[axis] < LUT_MASK && sampled[cell + stride] != sampled[cell])) {
+                lut[cell] = ORBBEC_GREENSCREEN_CHECK;
+            }
+        }
+    }
+    return lut;
+}
+
+const uint8_t* orbbec_greenscreen_lut() {
+    static const std::vector<uint8_t> lut = _build_lut();
+    return lut.data();
+}
+
+void orbbec_greenscreen_mask_rows(const OrbbecPointKernelParams& params, int first_row, int end_row, uint8_t* mask) {
+    const uint8_t* lut = orbbec_greenscreen_lut();
+    for (int row = first_row; row < end_row; row++) {
+        size_t row_idx = (size_t)row * params.width;
+        const uint8_t* bgra = params.color + 4 * row_idx;
+        for (int col = params.first_col; col < params.end_col; col++) {
+            uint32_t cell =
+                ((uint32_t)(bgra[4*col + 2] >> LUT_SHIFT) << (2 * ORBBEC_GREENSCREEN_LUT_BITS)) |
+                ((uint32_t)(bgra[4*col + 1] >> LUT_SHIFT) << ORBBEC_GREENSCREEN_LUT_BITS) |
+                (uint32_t)(bgra[4*col + 0] >> LUT_SHIFT);
+            mask[row_idx + col] = lut[cell];
+        }
+    }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "OrbbecPointKernels.hpp"
+
+//
+// Greenscreen removal as a mask pass over the color image, done before the point kernel runs,
+// so green pixels are never deprojected or transformed.
+//
+// Classification uses a lookup table indexed by the top ORBBEC_GREENSCREEN_LUT_BITS bits of
+// r, g and b. The table is built once, by running isNotGreen() on 27 colors spread over every
+// cell (checking all 16.7M colors takes too long). Cells where isNotGreen() gives the same
+// answer for all samples (and does not change the color), and whose neighbours agree, are
+// decided by the table alone. For the cells on or near the boundary the mask says the
+// kernel has to call isNotGreen() itself. tests/test_orbbec_greenscreen checks that the
+// result is exactly the same as calling isNotGreen() for every color.
+//
+#define ORBBEC_GREENSCREEN_LUT_BITS 5
+
+/// Return the classification table, building it on first use. Thread-safe.
+const uint8_t* orbbec_greenscreen_lut();
+
+/// Compute the greenscreen mask for columns [params.first_col, params.end_col) of rows
+/// [first_row, end_row) of params.color. mask is indexed like the color image.
+void orbbec_greenscreen_mask_rows(const OrbbecPointKernelParams& params, int first_row, int end_row, uint8_t* mask);
@@ -0,0 +1,74 @@
+#include <cmath>
+
+#include "OrbbecNormals.hpp"
+
+/// Camera-space position (in depth units) of depth pixel (u, v). Returns false if it has no depth.
+static inline bool _grid_point(const OrbbecPointKernelParams& params, int u, int v, float* out) {
+    size_t idx = (size_t)v * params.width + u;
+    uint16_t depth = params.depth[idx];
+    if (depth < params.depth_min || depth > params.depth_max) return false;
+    float z = (float)depth;
+    out[0] = params.ray_x[idx] * z;
+    out[1] = params.ray_y[idx] * z;
+    out[2] = z;
+    return true;
+}
+
+/// Difference vector along one grid axis around center: central difference if both neighbours
+/// have depth, one-sided difference if only one of them has. Returns false if neither has.
+static inline bool _grid_tangent(const OrbbecPointKernelParams& params, const float* center, int u0, int v0, int u1, int v1, bool have0, bool have1, float* out) {
+    float p0[3], p1[3];
+    have0 = have0 && _grid_point(params, u0, v0, p0);
+    have1 = have1 && _grid_point(params, u1, v1, p1);
+    if (!have0 && !have1) return false;
+    if (!have0) for (int i = 0; i < 3; i++) p0[i] = center[i];
+    if (!have1) for (int i = 0; i < 3; i++) p1[i] = center[i];
+    for (int i = 0; i < 3; i++) out[i] = p1[i] - p0[i];
+    return true;
+}
+
+void orbbec_compute_normals(const OrbbecPointKernelParams& params, const uint32_t* pixels, size_t count, float* normals) {
+    // The rotation part of the trafo includes a uniform scale, which does not matter as we normalize.
+    const float* m = params.trafo;
+    for (size_t i = 0; i < count; i++) {
+        int u = (int)(pixels[i] % params.width);
+        int v = (int)(pixels[i] / params.width);
+        float center[3];
+        float n[3];
+        float dx[3], dy[3];
+        if (!_grid_point(params, u, v, center)) {
+            // Cannot happen for kernel output, but be safe.
+            center[0] = center[1] = 0;
+            center[2] = 1;
+        }
+        bool ok =
+            _grid_tangent(params, center, u-1, v, u+1, v, u > 0, u < params.width - 1, dx) &&
+            _grid_tangent(params, center, u, v-1, u, v+1, v > 0, v < params.height - 1, dy);
+        if (ok) {
+            n[0] = dy[1]*dx[2] - dy[2]*dx[1];
+            n[1] = dy[2]*dx[0] - dy[0]*dx[2];
+            n[2] = dy[0]*dx[1] - dy[1]*dx[0];
+            // Point towards the camera
+            if (n[0]*center[0] + n[1]*center[1] + n[2]*center[2] > 0) {
+                n[0] = -n[0];
+                n[1] = -n[1];
+                n[2] = -n[2];
+            }
+        }
+        if (!ok || (n[0] == 0 && n[1] == 0 && n[2] == 0)) {
+            n[0] = -center[0];
+            n[1] = -center[1];
+            n[2] = -center[2];
+        }
+        float* out = normals + 3*i;
+        out[0] = m[0]*n[0] + m[1]*n[1] + m[2]*n[2];
+        out[1] = m[4]*n[0] + m[5]*n[1] + m[6]*n[2];
+        out[2] = m[8]*n[0] + m[9]*n[1] + m[10]*n[2];
+        float length = std::sqrt(out[0]*out[0] + out[1]*out[1] + out[2]*out[2]);
+        if (length > 0) {
+            out[0] /= length;
+            out[1] /= length;
+            out[2] /= length;
+        }
+    }
+}
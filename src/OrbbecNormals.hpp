@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+
+#include "OrbbecPointKernels.hpp"
+
+/// Estimate world-space surface normals for points produced by a point kernel, from the
+/// neighbours of their depth pixels. On the organized depth grid neighbours are free to look up,
+/// so this needs no spatial search.
+/// pixels holds the depth pixel index of every point (the output_pixels of the kernel);
+/// normals receives 3 floats (unit length, pointing towards the camera) per point.
+/// Points without usable neighbours get a normal pointing straight at the camera.
+void orbbec_compute_normals(const OrbbecPointKernelParams& params, const uint32_t* pixels, size_t count, float* normals);
@@ -10,7 +10,7 @@ OrbbecPlaybackCamera::OrbbecPlaybackCamera(std::shared_ptr<ob::PlaybackDevice> c
 bool OrbbecPlaybackCamera::start_camera() {
     assert(camera_stopped);
     assert(!camera_started);
-    assert(camera_processing_thread == nullptr);
+    assert(!processing_task_active);
     assert(camera_pipeline == nullptr);
     playback_eof = false;
     if (debug) _log_debug("Starting pipeline");
@@ -26,6 +26,7 @@ bool OrbbecPlaybackCamera::start_camera() {
     }
 
     _post_start_this_camera();
+    _update_cam_to_world_matrix();
     // xxxjack _computePointSize()??
     camera_started = true;
     return true;
@@ -81,10 +82,12 @@ bool OrbbecPlaybackCamera::_init_pipeline_for_this_camera(std::shared_ptr<ob::Co
         config->enableVideoStream(OB_STREAM_COLOR, hardware.color_width, hardware.color_height, hardware.fps, OB_FORMAT_BGRA);
         config->enableVideoStream(OB_STREAM_DEPTH, hardware.depth_width, hardware.depth_height, hardware.fps, OB_FORMAT_Y16);
         config->setFrameAggregateOutputMode(OB_FRAME_AGGREGATE_OUTPUT_ALL_TYPE_FRAME_REQUIRE);
-#if 1
-        // xxxjack this is really only for depth2color mode.
-        config->setAlignMode(ALIGN_D2C_HW_MODE);
-#endif
+        if (filtering.map_color_to_depth) {
+            // Depth stays at its native resolution, color is looked up per depth pixel in software.
+            config->setAlignMode(ALIGN_DISABLE);
+        } else {
+            config->setAlignMode(ALIGN_D2C_HW_MODE);
+        }
     } catch(ob::Error& e) {
         _log_error(std::string("enableVideoStream error: ") + e.what());
         return false;
@@ -96,5 +99,5 @@ void OrbbecPlaybackCamera::start_camera_streaming() {
     assert(camera_stopped);
     camera_stopped = false;
     _start_capture_thread();
-    _start_processing_thread();
+    _start_processing();
 }
@@ -0,0 +1,86 @@
+#include "OrbbecPointKernels.hpp"
+#include "cwipc_util/internal/capturers.hpp"
+
+#if defined(CWIPC_ORBBEC_KERNELS_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+template<int Filters>
+size_t _point_kernel_scalar(const OrbbecPointKernelParams& params, int first_row, int end_row, cwipc_pcl_point* output, uint32_t* output_pixels) {
+    size_t npoint = 0;
+    for (int row = first_row; row < end_row; row++) {
+        const size_t end_idx = (size_t)row * params.width + params.end_col;
+        for (size_t idx = (size_t)row * params.width + params.first_col; idx < end_idx; idx++) {
+            npoint += _orbbec_point_kernel_pixel<Filters>(params, idx, output, output_pixels, npoint);
+        }
+    }
+    return npoint;
+}
+}
+
+const OrbbecPointKernelSet orbbec_point_kernels_scalar = {
+    "scalar",
+    _CWIPC_ORBBEC_POINT_KERNELS(_point_kernel_scalar)
+};
+
+bool orbbec_point_is_not_green(cwipc_pcl_point* pt) {
+    return isNotGreen(pt);
+}
+
+#ifdef CWIPC_ORBBEC_KERNELS_X86
+#ifdef _MSC_VER
+static bool _cpu_has_avx2() {
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return false;
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    if (!osxsave || !avx) return false;
+    // OS must save the YMM registers
+    if ((_xgetbv(0) & 0x6) != 0x6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+
+static bool _cpu_has_avx512() {
+    if (!_cpu_has_avx2()) return false;
+    int info[4];
+    // OS must also save the opmask and ZMM registers
+    if ((_xgetbv(0) & 0xe6) != 0xe6) return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 16)) != 0;
+}
+#else
+static bool _cpu_has_avx2() {
+    return __builtin_cpu_supports("avx2");
+}
+
+static bool _cpu_has_avx512() {
+    return __builtin_cpu_supports("avx512f");
+}
+#endif
+#endif
+
+const OrbbecPointKernelSet& orbbec_select_point_kernels() {
+    return *orbbec_supported_point_kernels().front();
+}
+
+std::vector<const OrbbecPointKernelSet*> orbbec_supported_point_kernels() {
+    std::vector<const OrbbecPointKernelSet*> rv;
+#ifdef CWIPC_ORBBEC_KERNELS_X86
+    if (_cpu_has_avx512()) {
+        rv.push_back(&orbbec_point_kernels_avx512);
+    }
+    if (_cpu_has_avx2()) {
+        rv.push_back(&orbbec_point_kernels_avx2);
+    }
+#endif
+#ifdef CWIPC_ORBBEC_KERNELS_NEON
+    rv.push_back(&orbbec_point_kernels_neon);
+#endif
+    rv.push_back(&orbbec_point_kernels_scalar);
+    return rv;
+}
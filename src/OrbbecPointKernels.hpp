@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "cwipc_util/api_pcl.h"
+
+//
+// Point kernels: the fused per-pixel loop that deprojects depth pixels, transforms them to
+// world coordinates, filters them and stores the surviving points.
+//
+// There is a scalar version and SIMD versions for the CPUs we care about. The best one is
+// selected at runtime. All versions do exactly the same single-precision operations in
+// exactly the same order (and the kernel sources are compiled without floating point
+// contraction) so they produce bit-identical point clouds.
+//
+#if defined(__x86_64__) || defined(_M_X64)
+#define CWIPC_ORBBEC_KERNELS_X86
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define CWIPC_ORBBEC_KERNELS_NEON
+#endif
+
+/// Everything a point kernel needs to turn one depth image into points.
+struct OrbbecPointKernelParams {
+    int width = 0;                      //<! Width of depth image, color image and ray tables
+    int height = 0;                     //<! Height of depth image, color image and ray tables
+    const uint16_t* depth = nullptr;    //<! Y16 depth image
+    const uint8_t* color = nullptr;     //<! BGRA color image, aligned to the depth image
+    const float* ray_x = nullptr;       //<! Per-pixel ray x components (from OrbbecDeprojector)
+    const float* ray_y = nullptr;       //<! Per-pixel ray y components (from OrbbecDeprojector)
+    int first_col = 0;                  //<! Only columns [first_col, end_col) of each row are looked at
+    int end_col = 0;
+    uint16_t depth_min = 1;             //<! Pixels with depth values below this are skipped (must be at least 1)
+    uint16_t depth_max = 65535;         //<! Pixels with depth values above this are skipped
+    float trafo[12] = {};               //<! Depth-units-to-world-meters transform, 3x4 row-major
+    bool do_height_filtering = false;   //<! Drop points with y outside [height_min, height_max]
+    float height_min = 0;
+    float height_max = 0;
+    bool do_radius_filtering = false;   //<! Drop points further than sqrt(radius_squared) from the y axis
+    float radius_squared = 0;
+    bool do_greenscreen_removal = false;//<! Drop green points
+    const uint8_t* greenscreen_mask = nullptr;  //<! Per-pixel ORBBEC_GREENSCREEN_* values, required for greenscreen removal
+    uint8_t tile = 0;                   //<! Tile mask stored in the alpha channel of every point
+};
+
+/// Filters a point kernel can apply. Every kernel is compiled for every combination, so the
+/// per-pixel loop has no tests for filters that are not enabled.
+enum {
+    ORBBEC_POINT_FILTER_HEIGHT = 1,         //<! params.do_height_filtering
+    ORBBEC_POINT_FILTER_RADIUS = 2,         //<! params.do_radius_filtering
+    ORBBEC_POINT_FILTER_GREENSCREEN = 4,    //<! params.do_greenscreen_removal
+    ORBBEC_POINT_FILTER_COMBINATIONS = 8
+};
+
+/// Values in the greenscreen mask (see OrbbecGreenscreen.hpp).
+enum {
+    ORBBEC_GREENSCREEN_REMOVE = 0,  //<! Pixel is green, skip it
+    ORBBEC_GREENSCREEN_KEEP = 1,    //<! Pixel is not green, keep it as-is
+    ORBBEC_GREENSCREEN_CHECK = 2    //<! Pixel needs the exact isNotGreen() test
+};
+
+/// A point kernel turns columns [params.first_col, params.end_col) of rows [first_row, end_row)
+/// of the depth image in params into filtered world-space points. output must have room for a
+/// point per pixel in those rows. If output_pixels is not null the index of the depth pixel
+/// every point came from is stored in it too, at the same offset as the point.
+/// Returns the number of points stored.
+typedef size_t (*OrbbecPointKernel)(const OrbbecPointKernelParams& params, int first_row, int end_row, cwipc_pcl_point* output, uint32_t* output_pixels);
+
+/// All specializations of the point kernel for one instruction set, indexed by filter combination.
+struct OrbbecPointKernelSet {
+    const char* name;
+    OrbbecPointKernel kernels[ORBBEC_POINT_FILTER_COMBINATIONS];
+
+    /// Return the kernel specialized for the filters enabled in params.
+    OrbbecPointKernel select(const OrbbecPointKernelParams& params) const {
+        int filters = 0;
+        if (params.do_height_filtering) filters |= ORBBEC_POINT_FILTER_HEIGHT;
+        if (params.do_radius_filtering) filters |= ORBBEC_POINT_FILTER_RADIUS;
+        if (params.do_greenscreen_removal) filters |= ORBBEC_POINT_FILTER_GREENSCREEN;
+        return kernels[filters];
+    }
+};
+
+/// Initializer for OrbbecPointKernelSet::kernels from a kernel template.
+#define _CWIPC_ORBBEC_POINT_KERNELS(kernel) { kernel<0>, kernel<1>, kernel<2>, kernel<3>, kernel<4>, kernel<5>, kernel<6>, kernel<7> }
+
+extern const OrbbecPointKernelSet orbbec_point_kernels_scalar;
+#ifdef CWIPC_ORBBEC_KERNELS_X86
+extern const OrbbecPointKernelSet orbbec_point_kernels_avx2;
+extern const OrbbecPointKernelSet orbbec_point_kernels_avx512;
+#endif
+#ifdef CWIPC_ORBBEC_KERNELS_NEON
+extern const OrbbecPointKernelSet orbbec_point_kernels_neon;
+#endif
+
+/// Return the fastest point kernels this CPU supports.
+const OrbbecPointKernelSet& orbbec_select_point_kernels();
+
+/// Return all point kernels this CPU supports, fastest first (the scalar kernels are always last).
+/// Used by the tests that check all kernels produce identical output.
+std::vector<const OrbbecPointKernelSet*> orbbec_supported_point_kernels();
+
+/// Greenscreen test used by all kernels. Deliberately out-of-line: it calls inline code from
+/// cwipc_util, which must not be compiled into the SIMD functions.
+bool orbbec_point_is_not_green(cwipc_pcl_point* pt);
+
+/// Store a point that passed the geometric filters, with its color. Returns false if the
+/// point was removed by greenscreen removal after all (only possible if the greenscreen mask
+/// says it needs the exact test).
+template<int Filters>
+static inline bool _orbbec_point_kernel_emit(const OrbbecPointKernelParams& params, size_t idx, float x, float y, float z, cwipc_pcl_point* output, uint32_t* output_pixels, size_t npoint) {
+    const uint8_t* bgra = params.color + 4*idx;
+    cwipc_pcl_point* out = output + npoint;
+    out->x = x;
+    out->y = y;
+    out->z = z;
+    out->data[3] = 1.0f;
+    out->r = bgra[2];
+    out->g = bgra[1];
+    out->b = bgra[0];
+    out->a = params.tile;
+    if ((Filters & ORBBEC_POINT_FILTER_GREENSCREEN) && params.greenscreen_mask[idx] == ORBBEC_GREENSCREEN_CHECK && !orbbec_point_is_not_green(out)) {
+        return false;
+    }
+    if (output_pixels != nullptr) {
+        output_pixels[npoint] = (uint32_t)idx;
+    }
+    return true;
+}
+
+/// Scalar reference implementation for a single pixel, storing at offset npoint. The SIMD kernels
+/// use it for the pixels left over after their vector loop. Returns the number of points stored (0 or 1).
+template<int Filters>
+static inline size_t _orbbec_point_kernel_pixel(const OrbbecPointKernelParams& params, size_t idx, cwipc_pcl_point* output, uint32_t* output_pixels, size_t npoint) {
+    uint16_t depth = params.depth[idx];
+    if (depth < params.depth_min || depth > params.depth_max) return 0;
+    if ((Filters & ORBBEC_POINT_FILTER_GREENSCREEN) && params.greenscreen_mask[idx] == ORBBEC_GREENSCREEN_REMOVE) return 0;
+    float z = (float)depth;
+    float x = params.ray_x[idx] * z;
+    float y = params.ray_y[idx] * z;
+    const float* m = params.trafo;
+    float wx = m[0]*x + m[1]*y + m[2]*z + m[3];
+    float wy = m[4]*x + m[5]*y + m[6]*z + m[7];
+    float wz = m[8]*x + m[9]*y + m[10]*z + m[11];
+    if ((Filters & ORBBEC_POINT_FILTER_HEIGHT) && (wy < params.height_min || wy > params.height_max)) {
+        return 0;
+    }
+    if ((Filters & ORBBEC_POINT_FILTER_RADIUS) && !(wx*wx + wz*wz < params.radius_squared)) {
+        return 0;
+    }
+    return _orbbec_point_kernel_emit<Filters>(params, idx, wx, wy, wz, output, output_pixels, npoint) ? 1 : 0;
+}
+
+/// Index of the lowest set bit in a (non-zero) lane mask.
+static inline int _orbbec_point_kernel_ctz(uint32_t mask) {
+#ifdef _MSC_VER
+    unsigned long rv;
+    _BitScanForward(&rv, mask);
+    return (int)rv;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
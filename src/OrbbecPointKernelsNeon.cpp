@@ -0,0 +1,81 @@
+#include "OrbbecPointKernels.hpp"
+
+#ifdef CWIPC_ORBBEC_KERNELS_NEON
+#include <arm_neon.h>
+#include <cstring>
+
+//
+// NEON point kernel. NEON is always available on 64-bit ARM, so no runtime check is needed.
+//
+namespace {
+template<int Filters>
+size_t _point_kernel_neon(const OrbbecPointKernelParams& params, int first_row, int end_row, cwipc_pcl_point* output, uint32_t* output_pixels) {
+    float32x4_t m[12];
+    for (int i = 0; i < 12; i++) {
+        m[i] = vdupq_n_f32(params.trafo[i]);
+    }
+    const float32x4_t height_min = vdupq_n_f32(params.height_min);
+    const float32x4_t height_max = vdupq_n_f32(params.height_max);
+    const float32x4_t radius_squared = vdupq_n_f32(params.radius_squared);
+    const uint32x4_t depth_min = vdupq_n_u32(params.depth_min);
+    const uint32x4_t depth_max = vdupq_n_u32(params.depth_max);
+    const uint32_t lane_bit_values[4] = { 1, 2, 4, 8 };
+    const uint32x4_t lane_bits = vld1q_u32(lane_bit_values);
+    float wx_lanes[4];
+    float wy_lanes[4];
+    float wz_lanes[4];
+    size_t npoint = 0;
+    for (int row = first_row; row < end_row; row++) {
+        size_t idx = (size_t)row * params.width + params.first_col;
+        const size_t end_idx = (size_t)row * params.width + params.end_col;
+        for (; idx + 4 <= end_idx; idx += 4) {
+            uint32x4_t depth = vmovl_u16(vld1_u16(params.depth + idx));
+            uint32x4_t keep_mask = vandq_u32(vcgeq_u32(depth, depth_min), vcleq_u32(depth, depth_max));
+            if (Filters & ORBBEC_POINT_FILTER_GREENSCREEN) {
+                uint32_t greenscreen_bytes;
+                memcpy(&greenscreen_bytes, params.greenscreen_mask + idx, 4);
+                uint32x4_t greenscreen = vmovl_u16(vget_low_u16(vmovl_u8(vreinterpret_u8_u32(vdup_n_u32(greenscreen_bytes)))));
+                keep_mask = vandq_u32(keep_mask, vtstq_u32(greenscreen, greenscreen));
+            }
+            if (vaddvq_u32(vandq_u32(keep_mask, lane_bits)) == 0) continue;
+            float32x4_t z = vcvtq_f32_u32(depth);
+            float32x4_t x = vmulq_f32(vld1q_f32(params.ray_x + idx), z);
+            float32x4_t y = vmulq_f32(vld1q_f32(params.ray_y + idx), z);
+            float32x4_t wx = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(m[0], x), vmulq_f32(m[1], y)), vmulq_f32(m[2], z)), m[3]);
+            float32x4_t wy = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(m[4], x), vmulq_f32(m[5], y)), vmulq_f32(m[6], z)), m[7]);
+            float32x4_t wz = vaddq_f32(vaddq_f32(vaddq_f32(vmulq_f32(m[8], x), vmulq_f32(m[9], y)), vmulq_f32(m[10], z)), m[11]);
+            if (Filters & ORBBEC_POINT_FILTER_HEIGHT) {
+                // Written as !(wy < min) && !(wy > max) to match the scalar code for NaN
+                keep_mask = vbicq_u32(keep_mask, vcltq_f32(wy, height_min));
+                keep_mask = vbicq_u32(keep_mask, vcgtq_f32(wy, height_max));
+            }
+            if (Filters & ORBBEC_POINT_FILTER_RADIUS) {
+                float32x4_t distance_squared = vaddq_f32(vmulq_f32(wx, wx), vmulq_f32(wz, wz));
+                keep_mask = vandq_u32(keep_mask, vcltq_f32(distance_squared, radius_squared));
+            }
+            uint32_t keep = vaddvq_u32(vandq_u32(keep_mask, lane_bits));
+            if (keep == 0) continue;
+            vst1q_f32(wx_lanes, wx);
+            vst1q_f32(wy_lanes, wy);
+            vst1q_f32(wz_lanes, wz);
+            while (keep) {
+                int lane = _orbbec_point_kernel_ctz(keep);
+                keep &= keep - 1;
+                if (_orbbec_point_kernel_emit<Filters>(params, idx + lane, wx_lanes[lane], wy_lanes[lane], wz_lanes[lane], output, output_pixels, npoint)) {
+                    npoint++;
+                }
+            }
+        }
+        for (; idx < end_idx; idx++) {
+            npoint += _orbbec_point_kernel_pixel<Filters>(params, idx, output, output_pixels, npoint);
+        }
+    }
+    return npoint;
+}
+}
+
+const OrbbecPointKernelSet orbbec_point_kernels_neon = {
+    "neon",
+    _CWIPC_ORBBEC_POINT_KERNELS(_point_kernel_neon)
+};
+#endif
@@ -0,0 +1,154 @@
+#include "OrbbecPointKernels.hpp"
+
+#ifdef CWIPC_ORBBEC_KERNELS_X86
+#include <immintrin.h>
+
+//
+// AVX2 and AVX-512 point kernels. These are selected at runtime by orbbec_select_point_kernel(),
+// so they are compiled with function-level target attributes in stead of global compiler flags.
+//
+#ifdef _MSC_VER
+#define _CWIPC_ORBBEC_TARGET_AVX2
+#define _CWIPC_ORBBEC_TARGET_AVX512
+#else
+#define _CWIPC_ORBBEC_TARGET_AVX2 __attribute__((target("avx2")))
+#define _CWIPC_ORBBEC_TARGET_AVX512 __attribute__((target("avx512f")))
+#endif
+
+namespace {
+
+template<int Filters>
+_CWIPC_ORBBEC_TARGET_AVX2
+size_t _point_kernel_avx2(const OrbbecPointKernelParams& params, int first_row, int end_row, cwipc_pcl_point* output, uint32_t* output_pixels) {
+    __m256 m[12];
+    for (int i = 0; i < 12; i++) {
+        m[i] = _mm256_set1_ps(params.trafo[i]);
+    }
+    const __m256 height_min = _mm256_set1_ps(params.height_min);
+    const __m256 height_max = _mm256_set1_ps(params.height_max);
+    const __m256 radius_squared = _mm256_set1_ps(params.radius_squared);
+    const __m256i depth_min = _mm256_set1_epi32(params.depth_min);
+    const __m256i depth_max = _mm256_set1_epi32(params.depth_max);
+    alignas(32) float wx_lanes[8];
+    alignas(32) float wy_lanes[8];
+    alignas(32) float wz_lanes[8];
+    size_t npoint = 0;
+    for (int row = first_row; row < end_row; row++) {
+        size_t idx = (size_t)row * params.width + params.first_col;
+        const size_t end_idx = (size_t)row * params.width + params.end_col;
+        for (; idx + 8 <= end_idx; idx += 8) {
+            __m256i depth = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)(params.depth + idx)));
+            __m256i outside = _mm256_or_si256(_mm256_cmpgt_epi32(depth_min, depth), _mm256_cmpgt_epi32(depth, depth_max));
+            uint32_t keep = ~(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(outside)) & 0xff;
+            if (Filters & ORBBEC_POINT_FILTER_GREENSCREEN) {
+                __m256i greenscreen = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(params.greenscreen_mask + idx)));
+                __m256i green = _mm256_cmpeq_epi32(greenscreen, _mm256_setzero_si256());
+                keep &= ~(uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(green));
+            }
+            if (keep == 0) continue;
+            __m256 z = _mm256_cvtepi32_ps(depth);
+            __m256 x = _mm256_mul_ps(_mm256_loadu_ps(params.ray_x + idx), z);
+            __m256 y = _mm256_mul_ps(_mm256_loadu_ps(params.ray_y + idx), z);
+            __m256 wx = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[0], x), _mm256_mul_ps(m[1], y)), _mm256_mul_ps(m[2], z)), m[3]);
+            __m256 wy = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[4], x), _mm256_mul_ps(m[5], y)), _mm256_mul_ps(m[6], z)), m[7]);
+            __m256 wz = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m[8], x), _mm256_mul_ps(m[9], y)), _mm256_mul_ps(m[10], z)), m[11]);
+            if (Filters & ORBBEC_POINT_FILTER_HEIGHT) {
+                __m256 inside = _mm256_and_ps(_mm256_cmp_ps(wy, height_min, _CMP_NLT_UQ), _mm256_cmp_ps(wy, height_max, _CMP_NGT_UQ));
+                keep &= (uint32_t)_mm256_movemask_ps(inside);
+            }
+            if (Filters & ORBBEC_POINT_FILTER_RADIUS) {
+                __m256 distance_squared = _mm256_add_ps(_mm256_mul_ps(wx, wx), _mm256_mul_ps(wz, wz));
+                keep &= (uint32_t)_mm256_movemask_ps(_mm256_cmp_ps(distance_squared, radius_squared, _CMP_LT_OQ));
+            }
+            if (keep == 0) continue;
+            _mm256_store_ps(wx_lanes, wx);
+            _mm256_store_ps(wy_lanes, wy);
+            _mm256_store_ps(wz_lanes, wz);
+            while (keep) {
+                int lane = _orbbec_point_kernel_ctz(keep);
+                keep &= keep - 1;
+                if (_orbbec_point_kernel_emit<Filters>(params, idx + lane, wx_lanes[lane], wy_lanes[lane], wz_lanes[lane], output, output_pixels, npoint)) {
+                    npoint++;
+                }
+            }
+        }
+        for (; idx < end_idx; idx++) {
+            npoint += _orbbec_point_kernel_pixel<Filters>(params, idx, output, output_pixels, npoint);
+        }
+    }
+    return npoint;
+}
+
+template<int Filters>
+_CWIPC_ORBBEC_TARGET_AVX512
+size_t _point_kernel_avx512(const OrbbecPointKernelParams& params, int first_row, int end_row, cwipc_pcl_point* output, uint32_t* output_pixels) {
+    __m512 m[12];
+    for (int i = 0; i < 12; i++) {
+        m[i] = _mm512_set1_ps(params.trafo[i]);
+    }
+    const __m512 height_min = _mm512_set1_ps(params.height_min);
+    const __m512 height_max = _mm512_set1_ps(params.height_max);
+    const __m512 radius_squared = _mm512_set1_ps(params.radius_squared);
+    const __m512i depth_min = _mm512_set1_epi32(params.depth_min);
+    const __m512i depth_max = _mm512_set1_epi32(params.depth_max);
+    alignas(64) float wx_lanes[16];
+    alignas(64) float wy_lanes[16];
+    alignas(64) float wz_lanes[16];
+    size_t npoint = 0;
+    for (int row = first_row; row < end_row; row++) {
+        size_t idx = (size_t)row * params.width + params.first_col;
+        const size_t end_idx = (size_t)row * params.width + params.end_col;
+        for (; idx + 16 <= end_idx; idx += 16) {
+            __m512i depth = _mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)(params.depth + idx)));
+            __mmask16 keep = _mm512_cmp_epi32_mask(depth, depth_min, _MM_CMPINT_NLT);
+            keep = _mm512_mask_cmp_epi32_mask(keep, depth, depth_max, _MM_CMPINT_LE);
+            if (Filters & ORBBEC_POINT_FILTER_GREENSCREEN) {
+                __m512i greenscreen = _mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)(params.greenscreen_mask + idx)));
+                keep = _mm512_mask_cmp_epi32_mask(keep, greenscreen, _mm512_setzero_si512(), _MM_CMPINT_NE);
+            }
+            if (keep == 0) continue;
+            __m512 z = _mm512_cvtepi32_ps(depth);
+            __m512 x = _mm512_mul_ps(_mm512_loadu_ps(params.ray_x + idx), z);
+            __m512 y = _mm512_mul_ps(_mm512_loadu_ps(params.ray_y + idx), z);
+            __m512 wx = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(m[0], x), _mm512_mul_ps(m[1], y)), _mm512_mul_ps(m[2], z)), m[3]);
+            __m512 wy = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(m[4], x), _mm512_mul_ps(m[5], y)), _mm512_mul_ps(m[6], z)), m[7]);
+            __m512 wz = _mm512_add_ps(_mm512_add_ps(_mm512_add_ps(_mm512_mul_ps(m[8], x), _mm512_mul_ps(m[9], y)), _mm512_mul_ps(m[10], z)), m[11]);
+            if (Filters & ORBBEC_POINT_FILTER_HEIGHT) {
+                keep = _mm512_mask_cmp_ps_mask(keep, wy, height_min, _CMP_NLT_UQ);
+                keep = _mm512_mask_cmp_ps_mask(keep, wy, height_max, _CMP_NGT_UQ);
+            }
+            if (Filters & ORBBEC_POINT_FILTER_RADIUS) {
+                __m512 distance_squared = _mm512_add_ps(_mm512_mul_ps(wx, wx), _mm512_mul_ps(wz, wz));
+                keep = _mm512_mask_cmp_ps_mask(keep, distance_squared, radius_squared, _CMP_LT_OQ);
+            }
+            if (keep == 0) continue;
+            _mm512_store_ps(wx_lanes, wx);
+            _mm512_store_ps(wy_lanes, wy);
+            _mm512_store_ps(wz_lanes, wz);
+            uint32_t lanes = (uint32_t)keep;
+            while (lanes) {
+                int lane = _orbbec_point_kernel_ctz(lanes);
+                lanes &= lanes - 1;
+                if (_orbbec_point_kernel_emit<Filters>(params, idx + lane, wx_lanes[lane], wy_lanes[lane], wz_lanes[lane], output, output_pixels, npoint)) {
+                    npoint++;
+                }
+            }
+        }
+        for (; idx < end_idx; idx++) {
+            npoint += _orbbec_point_kernel_pixel<Filters>(params, idx, output, output_pixels, npoint);
+        }
+    }
+    return npoint;
+}
+}
+
+const OrbbecPointKernelSet orbbec_point_kernels_avx2 = {
+    "avx2",
+    _CWIPC_ORBBEC_POINT_KERNELS(_point_kernel_avx2)
+};
+
+const OrbbecPointKernelSet orbbec_point_kernels_avx512 = {
+    "avx512",
+    _CWIPC_ORBBEC_POINT_KERNELS(_point_kernel_avx512)
+};
+#endif
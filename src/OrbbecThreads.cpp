@@ -0,0 +1,114 @@
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#if defined(WIN32) || defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "OrbbecThreads.hpp"
+
+bool orbbec_parse_cpu_list(const std::string& list, std::vector<int>& cpus) {
+    cpus.clear();
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        // Allow whitespace around the ranges, and a trailing newline (as in the sysfs files).
+        size_t first = range.find_first_not_of(" \t\n");
+        if (first == std::string::npos) continue;
+        range = range.substr(first, range.find_last_not_of(" \t\n") - first + 1);
+        int low, high;
+        char dash;
+        std::stringstream rs(range);
+        if (!(rs >> low) || low < 0) return false;
+        high = low;
+        if (rs >> dash) {
+            if (dash != '-' || !(rs >> high) || high < low) return false;
+        }
+        if (!rs.eof()) return false;
+        for (int cpu = low; cpu <= high; cpu++) {
+            cpus.push_back(cpu);
+        }
+    }
+    return true;
+}
+
+bool orbbec_numa_node_cpus(int node, std::vector<int>& cpus) {
+    cpus.clear();
+#if defined(__linux__)
+    std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    if (!cpulist || !std::getline(cpulist, list)) return false;
+    return orbbec_parse_cpu_list(list, cpus) && !cpus.empty();
+#else
+    return false;
+#endif
+}
+
+bool orbbec_set_thread_policy(std::thread* thread, const std::vector<int>& cpus, int priority, std::string& error) {
+    if (priority < 0 || priority > 99) {
+        error = "priority must be between 0 and 99";
+        return false;
+    }
+#if defined(WIN32) || defined(_WIN32)
+    HANDLE handle = (HANDLE)thread->native_handle();
+    if (!cpus.empty()) {
+        DWORD_PTR mask = 0;
+        for (int cpu : cpus) {
+            if (cpu >= (int)(8 * sizeof(mask))) {
+                error = "cpu " + std::to_string(cpu) + " outside the processor group";
+                return false;
+            }
+            mask |= (DWORD_PTR)1 << cpu;
+        }
+        if (SetThreadAffinityMask(handle, mask) == 0) {
+            error = "SetThreadAffinityMask failed: error " + std::to_string(GetLastError());
+            return false;
+        }
+    }
+    if (priority > 0) {
+        int level = priority > 66 ? THREAD_PRIORITY_TIME_CRITICAL : priority > 33 ? THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_ABOVE_NORMAL;
+        if (!SetThreadPriority(handle, level)) {
+            error = "SetThreadPriority failed: error " + std::to_string(GetLastError());
+            return false;
+        }
+    }
+#else
+    pthread_t handle = thread->native_handle();
+    if (!cpus.empty()) {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int cpu : cpus) {
+            if (cpu >= CPU_SETSIZE) {
+                error = "cpu " + std::to_string(cpu) + " out of range";
+                return false;
+            }
+            CPU_SET(cpu, &set);
+        }
+        int rv = pthread_setaffinity_np(handle, sizeof(set), &set);
+        if (rv != 0) {
+            error = std::string("pthread_setaffinity_np: ") + strerror(rv);
+            return false;
+        }
+#else
+        error = "cpu affinity not supported on this platform";
+        return false;
+#endif
+    }
+    if (priority > 0) {
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = priority;
+        int rv = pthread_setschedparam(handle, SCHED_FIFO, &param);
+        if (rv != 0) {
+            error = std::string("pthread_setschedparam: ") + strerror(rv);
+            return false;
+        }
+    }
+#endif
+    return true;
+}
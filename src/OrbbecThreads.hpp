@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <thread>
+
+/// Parse a CPU list like "0-3,8,10-11" (the Linux cpuset syntax). An empty string gives an empty list.
+/// Returns false if the string is malformed.
+bool orbbec_parse_cpu_list(const std::string& list, std::vector<int>& cpus);
+
+/// Get the CPUs of NUMA node node. Returns false if there is no such node (or NUMA information
+/// is not available on this platform).
+bool orbbec_numa_node_cpus(int node, std::vector<int>& cpus);
+
+/// Restrict thread to the given CPUs (if cpus is not empty) and give it real-time priority
+/// priority (1 to 99, if priority is not 0). Returns false and sets error if that is not possible,
+/// for example because we lack the privileges.
+bool orbbec_set_thread_policy(std::thread* thread, const std::vector<int>& cpus, int priority, std::string& error);
@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "OrbbecTileCache.hpp"
+
+void OrbbecTileCache::begin(int _width, int _height, int _tile_size, bool with_normals, bool invalidate) {
+    if (_width != width || _height != height || _tile_size != tile_size) {
+        width = _width;
+        height = _height;
+        tile_size = _tile_size;
+        tiles_x = (width + tile_size - 1) / tile_size;
+        tiles_y = (height + tile_size - 1) / tile_size;
+        tile_capacity = (size_t)tile_size * tile_size;
+        point_buffer.resize(tile_count() * tile_capacity);
+        point_counts.assign(tile_count(), 0);
+        tile_valid.assign(tile_count(), 0);
+        reference_depth.assign((size_t)width * height, 0);
+        reference_color.assign(3 * tile_count(), 0);
+    }
+    if (with_normals != !pixel_buffer.empty()) {
+        // Cached tiles have no normals (or we no longer want them).
+        invalidate = true;
+        if (with_normals) {
+            pixel_buffer.resize(tile_count() * tile_capacity);
+            normal_buffer.resize(3 * tile_count() * tile_capacity);
+        } else {
+            pixel_buffer.clear();
+            pixel_buffer.shrink_to_fit();
+            normal_buffer.clear();
+            normal_buffer.shrink_to_fit();
+        }
+    }
+    if (invalidate) {
+        std::fill(tile_valid.begin(), tile_valid.end(), 0);
+        std::fill(point_counts.begin(), point_counts.end(), 0);
+    }
+    frame++;
+}
+
+void OrbbecTileCache::tile_rect(int tile, int& first_col, int& end_col, int& first_row, int& end_row) const {
+    first_col = (tile % tiles_x) * tile_size;
+    end_col = std::min(width, first_col + tile_size);
+    first_row = (tile / tiles_x) * tile_size;
+    end_row = std::min(height, first_row + tile_size);
+}
+
+bool OrbbecTileCache::changed(int tile, const uint16_t* depth, uint16_t tolerance, const uint8_t* bgra, int color_tolerance, int refresh_frames) {
+    int first_col, end_col, first_row, end_row;
+    tile_rect(tile, first_col, end_col, first_row, end_row);
+    // The color sums are cheap, and we need them as the new reference anyway.
+    uint64_t color[3] = { 0, 0, 0 };
+    for (int row = first_row; row < end_row; row++) {
+        const uint8_t* pixel = bgra + 4 * ((size_t)row * width + first_col);
+        for (int col = first_col; col < end_col; col++, pixel += 4) {
+            color[0] += pixel[0];
+            color[1] += pixel[1];
+            color[2] += pixel[2];
+        }
+    }
+    uint64_t* ref_color = reference_color.data() + 3 * tile;
+    uint64_t color_tolerance_sum = (uint64_t)std::max(0, color_tolerance) * (end_col - first_col) * (end_row - first_row);
+    bool is_changed = !tile_valid[tile] || (refresh_frames > 0 && (frame + tile) % refresh_frames == 0);
+    for (int c = 0; c < 3 && !is_changed; c++) {
+        uint64_t difference = color[c] > ref_color[c] ? color[c] - ref_color[c] : ref_color[c] - color[c];
+        if (difference > color_tolerance_sum) is_changed = true;
+    }
+    for (int row = first_row; row < end_row && !is_changed; row++) {
+        const uint16_t* d = depth + (size_t)row * width;
+        const uint16_t* ref = reference_depth.data() + (size_t)row * width;
+        for (int col = first_col; col < end_col; col++) {
+            // Appearing or disappearing depth always counts, otherwise only movement beyond the tolerance.
+            if ((d[col] == 0) != (ref[col] == 0) || std::abs((int)d[col] - (int)ref[col]) > tolerance) {
+                is_changed = true;
+                break;
+            }
+        }
+    }
+    if (!is_changed) return false;
+    for (int row = first_row; row < end_row; row++) {
+        size_t idx = (size_t)row * width + first_col;
+        std::copy(depth + idx, depth + idx + (end_col - first_col), reference_depth.begin() + idx);
+    }
+    std::copy(color, color + 3, ref_color);
+    tile_valid[tile] = 1;
+    return true;
+}
+
+void OrbbecTileCache::clear(int tile) {
+    tile_valid[tile] = 0;
+    point_counts[tile] = 0;
+}
+
+size_t OrbbecTileCache::total() const {
+    size_t npoint = 0;
+    for (size_t count : point_counts) {
+        npoint += count;
+    }
+    return npoint;
+}
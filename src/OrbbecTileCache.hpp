@@ -0,0 +1,61 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "cwipc_util/api_pcl.h"
+
+/// Cache of the points generated from square tiles of a depth image, for incremental point
+/// generation. A tile only has to be regenerated when its depth or its average color differs from
+/// what its cached points were generated from (or when it has not been regenerated for a while),
+/// so with mostly static content the cost scales with motion in stead of resolution.
+/// Each tile has its own fixed-size slice of the point buffer, so tiles can be regenerated in parallel.
+/// One instance per camera; the buffers are reused from frame to frame.
+class OrbbecTileCache {
+public:
+    OrbbecTileCache() {}
+    /// Start a new frame of width x height pixels with tiles of tile_size x tile_size pixels.
+    /// Forgets all cached points if the geometry changed or if invalidate is true.
+    /// Normals (and the depth pixel of every point) are only kept if with_normals is true.
+    void begin(int width, int height, int tile_size, bool with_normals, bool invalidate);
+    /// Number of tiles.
+    int tile_count() const { return tiles_x * tiles_y; }
+    /// Pixel rectangle covered by a tile.
+    void tile_rect(int tile, int& first_col, int& end_col, int& first_row, int& end_row) const;
+    /// Return true if the points of tile have to be regenerated from depth and bgra: it has no valid cached points,
+    /// or it is its turn to be refreshed (every tile once every refresh_frames frames, if refresh_frames > 0, spread out over the frames), or a depth pixel became valid or invalid or moved
+    /// by more than tolerance, or the average b, g or r of the tile changed by more than color_tolerance.
+    /// In that case depth and bgra become the new reference for the tile. Different tiles may be checked in parallel.
+    bool changed(int tile, const uint16_t* depth, uint16_t tolerance, const uint8_t* bgra, int color_tolerance, int refresh_frames);
+    /// Forget the cached points of a tile (for example because it is outside the region of interest).
+    void clear(int tile);
+    /// Buffer for the points of a tile, room for tile_size x tile_size points.
+    cwipc_pcl_point* points(int tile) { return point_buffer.data() + tile * tile_capacity; }
+    /// Buffer for the depth pixel of every point of a tile, or nullptr if not keeping normals.
+    uint32_t* pixels(int tile) { return pixel_buffer.empty() ? nullptr : pixel_buffer.data() + tile * tile_capacity; }
+    /// Buffer for the normal of every point of a tile, or nullptr if not keeping normals.
+    float* normals(int tile) { return normal_buffer.empty() ? nullptr : normal_buffer.data() + 3 * tile * tile_capacity; }
+    /// Number of cached points of a tile.
+    size_t count(int tile) const { return point_counts[tile]; }
+    /// Set the number of points generated for a tile.
+    void set_count(int tile, size_t count) { point_counts[tile] = count; }
+    /// Total number of cached points.
+    size_t total() const;
+
+private:
+    int width = 0;
+    int height = 0;
+    int tile_size = 0;
+    int tiles_x = 0;
+    int tiles_y = 0;
+    uint64_t frame = 0;                 //<! Number of begin() calls, to decide which tiles to refresh
+    size_t tile_capacity = 0;           //<! tile_size * tile_size
+    std::vector<cwipc_pcl_point, Eigen::aligned_allocator<cwipc_pcl_point>> point_buffer;
+    std::vector<uint32_t> pixel_buffer;
+    std::vector<float> normal_buffer;
+    std::vector<size_t> point_counts;   //<! Number of cached points of every tile
+    std::vector<uint8_t> tile_valid;    //<! True for tiles whose cached points and reference depth are valid
+    std::vector<uint16_t> reference_depth;  //<! Depth image the cached points of every tile were generated from
+    std::vector<uint64_t> reference_color;  //<! Sum of b, g and r over every tile when its cached points were generated
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+
+/// Lock-free handoff of the newest value from one producer thread to one consumer thread.
+/// There are three slots: the producer fills one, the consumer owns one, and the third holds
+/// the newest published value. Publishing and taking are a single atomic exchange each, so
+/// neither side ever waits for the other, and the consumer always gets the newest complete value.
+/// T is a pointer (or other cheap value) with T() meaning "nothing".
+template<class T> class OrbbecTripleBuffer {
+public:
+    OrbbecTripleBuffer() {}
+
+    /// Producer: make value the newest. Returns the previous value if the consumer never took it
+    /// (ownership returns to the producer, which usually frees it), otherwise T().
+    T publish(T value) {
+        slots[back] = value;
+        int old_middle = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = old_middle & INDEX;
+        T replaced = (old_middle & FRESH) ? slots[back] : T();
+        slots[back] = T();
+        return replaced;
+    }
+
+    /// Consumer (or anyone, as a hint): true if there is a value the consumer has not taken yet.
+    bool available() const {
+        return (middle.load(std::memory_order_acquire) & FRESH) != 0;
+    }
+
+    /// Consumer: take the newest value, or T() if nothing was published since the last take().
+    T take() {
+        if (!available()) return T();
+        int old_middle = middle.exchange(front, std::memory_order_acq_rel);
+        front = old_middle & INDEX;
+        T value = slots[front];
+        slots[front] = T();
+        return value;
+    }
+
+private:
+    static const int INDEX = 3;     //<! Mask for the slot index in middle
+    static const int FRESH = 4;     //<! Flag in middle: its slot has not been taken by the consumer
+    T slots[3] = {};
+    std::atomic<int> middle{1};     //<! Slot with the newest value (plus FRESH flag). Shared.
+    int front = 0;                  //<! Slot owned by the consumer
+    int back = 2;                   //<! Slot owned by the producer
+};
@@ -0,0 +1,179 @@
+#include <cmath>
+
+#include "OrbbecVoxelGrid.hpp"
+
+// Voxel coordinates are packed into 21 bits each, so with 1 mm voxels we cover +/- 1 km.
+static const int KEY_BITS = 21;
+static const int64_t KEY_OFFSET = (int64_t)1 << (KEY_BITS - 1);
+
+/// Voxel coordinate along one axis, offset to be in [0, 2^KEY_BITS). Returns false if it is not.
+static inline bool _voxel_coordinate(float value, float inverse_voxel_size, uint64_t& coordinate) {
+    // In double, so the range test also works for values that do not fit in an integer (and for NaN).
+    double voxel = std::floor((double)(value * inverse_voxel_size));
+    if (!(voxel >= -KEY_OFFSET && voxel < KEY_OFFSET)) return false;
+    coordinate = (uint64_t)((int64_t)voxel + KEY_OFFSET);
+    return true;
+}
+
+bool orbbec_voxel_key(const cwipc_pcl_point& pt, float inverse_voxel_size, uint64_t& key) {
+    uint64_t x, y, z;
+    if (!_voxel_coordinate(pt.x, inverse_voxel_size, x) ||
+        !_voxel_coordinate(pt.y, inverse_voxel_size, y) ||
+        !_voxel_coordinate(pt.z, inverse_voxel_size, z)) {
+        return false;
+    }
+    key = x << (2 * KEY_BITS) | y << KEY_BITS | z;
+    return true;
+}
+
+/// Size the slots for max_points and start a new stamp. Shared by both hash tables.
+template<class Slot>
+static void _begin_table(std::vector<Slot>& slots, uint64_t& slot_mask, uint32_t& stamp, size_t max_points) {
+    // At most half full, so probe sequences stay short.
+    size_t wanted = 16;
+    while (wanted < 2 * max_points) wanted *= 2;
+    if (slots.size() < wanted) {
+        slots.assign(wanted, Slot());
+        stamp = 0;
+    }
+    slot_mask = slots.size() - 1;
+    stamp++;
+    if (stamp == 0) {
+        // Wrapped around: old stamps could look current again.
+        for (Slot& slot : slots) slot.stamp = 0;
+        stamp = 1;
+    }
+}
+
+void OrbbecVoxelGrid::begin(float voxel_size, size_t max_points) {
+    inverse_voxel_size = 1.0f / voxel_size;
+    out_of_range_count = 0;
+    used_slots.clear();
+    used_slots.reserve(max_points);
+    _begin_table(slots, slot_mask, stamp, max_points);
+}
+
+void OrbbecVoxelGrid::add(const cwipc_pcl_point* points, const float* normals, size_t count) {
+    static const float no_normal[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < count; i++) {
+        const cwipc_pcl_point& pt = points[i];
+        const float* normal = normals != nullptr ? normals + 3*i : no_normal;
+        uint64_t key;
+        if (!orbbec_voxel_key(pt, inverse_voxel_size, key)) {
+            out_of_range_count++;
+            continue;
+        }
+        uint64_t index = orbbec_voxel_slot(key, slot_mask);
+        while (true) {
+            Slot& slot = slots[index];
+            if (slot.stamp != stamp) {
+                slot.key = key;
+                slot.stamp = stamp;
+                slot.count = 1;
+                slot.x = pt.x;
+                slot.y = pt.y;
+                slot.z = pt.z;
+                slot.r = pt.r;
+                slot.g = pt.g;
+                slot.b = pt.b;
+                slot.a = pt.a;
+                slot.nx = normal[0];
+                slot.ny = normal[1];
+                slot.nz = normal[2];
+                used_slots.push_back((uint32_t)index);
+                break;
+            }
+            if (slot.key == key) {
+                slot.count++;
+                slot.x += pt.x;
+                slot.y += pt.y;
+                slot.z += pt.z;
+                slot.r += pt.r;
+                slot.g += pt.g;
+                slot.b += pt.b;
+                slot.a |= pt.a;
+                slot.nx += normal[0];
+                slot.ny += normal[1];
+                slot.nz += normal[2];
+                break;
+            }
+            index = (index + 1) & slot_mask;
+        }
+    }
+}
+
+void OrbbecVoxelGrid::store(cwipc_pcl_pointcloud& pointcloud, std::vector<float>* normals) const {
+    pointcloud->reserve(pointcloud->size() + used_slots.size());
+    if (normals != nullptr) {
+        normals->reserve(normals->size() + 3 * used_slots.size());
+    }
+    for (uint32_t index : used_slots) {
+        const Slot& slot = slots[index];
+        float inverse_count = 1.0f / slot.count;
+        cwipc_pcl_point pt;
+        pt.x = slot.x * inverse_count;
+        pt.y = slot.y * inverse_count;
+        pt.z = slot.z * inverse_count;
+        pt.r = (uint8_t)((slot.r + slot.count / 2) / slot.count);
+        pt.g = (uint8_t)((slot.g + slot.count / 2) / slot.count);
+        pt.b = (uint8_t)((slot.b + slot.count / 2) / slot.count);
+        pt.a = slot.a;
+        pointcloud->push_back(pt);
+        if (normals != nullptr) {
+            float length = std::sqrt(slot.nx*slot.nx + slot.ny*slot.ny + slot.nz*slot.nz);
+            float inverse_length = length > 0 ? 1.0f / length : 0.0f;
+            normals->push_back(slot.nx * inverse_length);
+            normals->push_back(slot.ny * inverse_length);
+            normals->push_back(slot.nz * inverse_length);
+        }
+    }
+}
+
+const uint32_t OrbbecVoxelDeduplicator::NO_SLOT;
+
+void OrbbecVoxelDeduplicator::begin(float voxel_size, size_t max_points) {
+    inverse_voxel_size = 1.0f / voxel_size;
+    out_of_range_count = 0;
+    point_slots.clear();
+    point_slots.reserve(max_points);
+    camera_first_point.clear();
+    _begin_table(slots, slot_mask, stamp, max_points);
+}
+
+void OrbbecVoxelDeduplicator::add(int camera, const float* camera_position, const cwipc_pcl_point* points, size_t count) {
+    camera_first_point.resize(camera + 1, point_slots.size());
+    camera_first_point[camera] = point_slots.size();
+    for (size_t i = 0; i < count; i++) {
+        const cwipc_pcl_point& pt = points[i];
+        float dx = pt.x - camera_position[0];
+        float dy = pt.y - camera_position[1];
+        float dz = pt.z - camera_position[2];
+        float distance_squared = dx*dx + dy*dy + dz*dz;
+        uint64_t key;
+        if (!orbbec_voxel_key(pt, inverse_voxel_size, key)) {
+            out_of_range_count++;
+            point_slots.push_back(NO_SLOT);
+            continue;
+        }
+        uint64_t index = orbbec_voxel_slot(key, slot_mask);
+        while (true) {
+            Slot& slot = slots[index];
+            if (slot.stamp != stamp) {
+                slot.key = key;
+                slot.stamp = stamp;
+                slot.camera = camera;
+                slot.distance_squared = distance_squared;
+                break;
+            }
+            if (slot.key == key) {
+                if (distance_squared < slot.distance_squared) {
+                    slot.camera = camera;
+                    slot.distance_squared = distance_squared;
+                }
+                break;
+            }
+            index = (index + 1) & slot_mask;
+        }
+        point_slots.push_back((uint32_t)index);
+    }
+}
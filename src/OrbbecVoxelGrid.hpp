@@ -0,0 +1,91 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "cwipc_util/api_pcl.h"
+
+/// Compute the hash table key for the voxel a point is in. Voxel coordinates are packed into 21 bits
+/// each, so this returns false for points more than 2^20 voxels from the origin (and for NaN points).
+bool orbbec_voxel_key(const cwipc_pcl_point& pt, float inverse_voxel_size, uint64_t& key);
+
+/// Initial hash table slot for a voxel key, in a table of size slot_mask+1 (a power of 2).
+inline uint64_t orbbec_voxel_slot(uint64_t key, uint64_t slot_mask) {
+    return (key * 0x9E3779B97F4A7C15ull) >> 20 & slot_mask;
+}
+
+/// Voxel grid downsampling with a flat open-addressing hash table, in stead of the sort-based
+/// pcl::VoxelGrid. Every occupied voxel produces one point: the centroid of the points in it,
+/// with their average color. Output order is the order in which voxels were first hit, so the
+/// result is deterministic.
+/// One instance per camera; the table is reused from frame to frame.
+class OrbbecVoxelGrid {
+public:
+    OrbbecVoxelGrid() {}
+    /// Start a new frame with voxels of size voxel_size (meters) and at most max_points input points.
+    void begin(float voxel_size, size_t max_points);
+    /// Add points to their voxels. normals (3 floats per point) is optional.
+    /// Points outside the range of voxel keys are dropped.
+    void add(const cwipc_pcl_point* points, const float* normals, size_t count);
+    /// Number of occupied voxels.
+    size_t size() const { return used_slots.size(); }
+    /// Number of points dropped by add() since begin() because they were outside the range of voxel keys.
+    size_t out_of_range() const { return out_of_range_count; }
+    /// Append the voxel centroids to a point cloud, and optionally their average normals to normals.
+    void store(cwipc_pcl_pointcloud& pointcloud, std::vector<float>* normals = nullptr) const;
+
+private:
+    struct Slot {
+        uint64_t key;       //<! Packed voxel coordinates
+        uint32_t stamp;     //<! Frame in which this slot was last used. Slots from earlier frames are empty.
+        uint32_t count;     //<! Number of points in the voxel
+        float x, y, z;      //<! Sum of the point coordinates
+        uint32_t r, g, b;   //<! Sum of the point colors
+        uint8_t a;          //<! Tile mask (or of all points)
+        float nx, ny, nz;   //<! Sum of the point normals
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> used_slots;   //<! Indices of the slots used in this frame, in order of first use
+    uint64_t slot_mask = 0;             //<! slots.size() - 1, slots.size() is a power of 2
+    uint32_t stamp = 0;                 //<! Current frame
+    float inverse_voxel_size = 0;
+    size_t out_of_range_count = 0;
+};
+
+/// Removes near-duplicate points from overlapping cameras when merging. Every voxel is owned by
+/// one camera: the one with the point closest to its camera position (which usually also is
+/// the one looking at the surface most head-on). Points of other cameras in that voxel are dropped.
+/// Like OrbbecVoxelGrid this is a flat hash table, so it is linear in the number of points.
+class OrbbecVoxelDeduplicator {
+public:
+    OrbbecVoxelDeduplicator() {}
+    /// Start a new merge with voxels of size voxel_size (meters) and at most max_points points in total.
+    void begin(float voxel_size, size_t max_points);
+    /// Add the points of one camera (cameras must be added in order 0, 1, ...) so it can claim voxels.
+    /// Points outside the range of voxel keys do not claim a voxel, they are always kept.
+    void add(int camera, const float* camera_position, const cwipc_pcl_point* points, size_t count);
+    /// After all cameras have been added: return true if the i-th point added for camera should be kept.
+    bool keep(int camera, size_t i) const {
+        uint32_t slot = point_slots[camera_first_point[camera] + i];
+        return slot == NO_SLOT || slots[slot].camera == camera;
+    }
+    /// Number of points added since begin() that were outside the range of voxel keys.
+    size_t out_of_range() const { return out_of_range_count; }
+
+private:
+    struct Slot {
+        uint64_t key;       //<! Packed voxel coordinates
+        uint32_t stamp;     //<! Merge in which this slot was last used. Slots from earlier merges are empty.
+        int camera;         //<! Camera that owns the voxel
+        float distance_squared;  //<! Squared distance from the owning camera to its closest point in the voxel
+    };
+    std::vector<Slot> slots;
+    std::vector<uint32_t> point_slots;          //<! Slot of every point added, so keep() needs no hashing
+    std::vector<size_t> camera_first_point;     //<! Index in point_slots of the first point of every camera
+    uint64_t slot_mask = 0;
+    uint32_t stamp = 0;
+    float inverse_voxel_size = 0;
+    size_t out_of_range_count = 0;
+    static const uint32_t NO_SLOT = 0xffffffff; //<! In point_slots for points outside the range of voxel keys
+};
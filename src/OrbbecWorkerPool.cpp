@@ -0,0 +1,175 @@
+#include <algorithm>
+
+#include "OrbbecWorkerPool.hpp"
+#include "OrbbecThreads.hpp"
+#include "cwipc_util/internal/capturers.hpp"
+
+static std::mutex pool_mutex;
+static OrbbecWorkerPool* pool = nullptr;
+static int pool_thread_count = 0;       // Number of threads pool was (or will be) created with, 0 for the default
+static thread_local int current_worker = -1;    // Index of the worker running on this thread, or -1
+static const int BAND_MIN_ROWS = 16;            // Bands are at least this many rows, so the per-band overhead does not show
+static const int BANDS_PER_THREAD = 4;          // More bands than threads, so threads that finish early can help with the rest
+
+static int _default_thread_count() {
+    return (int)std::thread::hardware_concurrency() - 1;
+}
+
+OrbbecWorkerPool& OrbbecWorkerPool::instance() {
+    // Deliberately never destroyed: joining threads from a static destructor can deadlock
+    // when the library is unloaded.
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (pool == nullptr) {
+        pool = new OrbbecWorkerPool(pool_thread_count > 0 ? pool_thread_count : _default_thread_count());
+    }
+    return *pool;
+}
+
+bool OrbbecWorkerPool::set_thread_count(int nthread) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (pool != nullptr) {
+        int wanted = nthread > 0 ? nthread : _default_thread_count();
+        return wanted < 0 || pool->workers.size() == (size_t)wanted;
+    }
+    pool_thread_count = nthread;
+    return true;
+}
+
+OrbbecWorkerPool::OrbbecWorkerPool(int nthread) {
+    for (int i = 0; i < nthread; i++) {
+        workers.emplace_back(new Worker());
+    }
+    // Start the threads only when all workers exist: they steal from each other.
+    for (int i = 0; i < nthread; i++) {
+        workers[i]->thread = new std::thread(&OrbbecWorkerPool::_worker_main, this, i);
+        _cwipc_setThreadName(workers[i]->thread, L"cwipc_orbbec::worker_thread");
+    }
+}
+
+bool OrbbecWorkerPool::set_thread_policy(const std::vector<int>& cpus, int priority, std::string& error) {
+    for (auto& worker : workers) {
+        if (!orbbec_set_thread_policy(worker->thread, cpus, priority, error)) return false;
+    }
+    return true;
+}
+
+void OrbbecWorkerPool::run(int count, const std::function<void(int)>& fn) {
+    if (count <= 0) return;
+    if (count == 1 || workers.empty()) {
+        for (int i = 0; i < count; i++) {
+            fn(i);
+        }
+        return;
+    }
+    auto job = std::make_shared<Job>();
+    job->fn = &fn;
+    job->count = count;
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        jobs.push_back(job);
+    }
+    jobs_cv.notify_all();
+    // We help out ourselves, then wait for the workers to finish whatever they picked up.
+    _work_on(*job);
+    std::unique_lock<std::mutex> lock(job->done_mutex);
+    job->done_cv.wait(lock, [&job] { return job->done.load() == job->count; });
+}
+
+int OrbbecWorkerPool::row_band_count(int nrow) const {
+    return std::max(1, std::min(nrow / BAND_MIN_ROWS, concurrency() * BANDS_PER_THREAD));
+}
+
+void OrbbecWorkerPool::run_rows(int first_row, int end_row, const std::function<void(int, int, int)>& fn) {
+    int nrow = end_row - first_row;
+    if (nrow <= 0) return;
+    int nband = row_band_count(nrow);
+    int band_height = (nrow + nband - 1) / nband;
+    run(nband, [&](int band) {
+        int band_first_row = first_row + band * band_height;
+        int band_end_row = std::min(end_row, band_first_row + band_height);
+        if (band_first_row >= band_end_row) return;
+        fn(band, band_first_row, band_end_row);
+    });
+}
+
+void OrbbecWorkerPool::submit(std::function<void()> task) {
+    if (workers.empty()) {
+        task();
+        return;
+    }
+    int index = current_worker >= 0 ? current_worker : (int)(next_queue++ % workers.size());
+    {
+        std::lock_guard<std::mutex> lock(workers[index]->tasks_mutex);
+        workers[index]->tasks.push_back(std::move(task));
+    }
+    {
+        // Under jobs_mutex, so a worker that is about to sleep cannot miss it.
+        std::lock_guard<std::mutex> lock(jobs_mutex);
+        pending_tasks++;
+    }
+    jobs_cv.notify_one();
+}
+
+std::shared_ptr<OrbbecWorkerPool::Job> OrbbecWorkerPool::_next_job() {
+    while (!jobs.empty()) {
+        std::shared_ptr<Job> job = jobs.front();
+        if (job->next.load() < job->count) return job;
+        jobs.pop_front();
+    }
+    return nullptr;
+}
+
+void OrbbecWorkerPool::_work_on(Job& job) {
+    while (true) {
+        int i = job.next++;
+        if (i >= job.count) break;
+        (*job.fn)(i);
+        if (++job.done == job.count) {
+            std::lock_guard<std::mutex> lock(job.done_mutex);
+            job.done_cv.notify_all();
+        }
+    }
+}
+
+bool OrbbecWorkerPool::_take_task(int index, std::function<void()>& task) {
+    // Our own queue newest first (its data is most likely still in our cache), then steal the oldest task of another worker.
+    int nworker = (int)workers.size();
+    for (int i = 0; i < nworker; i++) {
+        Worker& worker = *workers[(index + i) % nworker];
+        std::lock_guard<std::mutex> lock(worker.tasks_mutex);
+        if (worker.tasks.empty()) continue;
+        if (i == 0) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+        } else {
+            task = std::move(worker.tasks.front());
+            worker.tasks.pop_front();
+        }
+        pending_tasks--;
+        return true;
+    }
+    return false;
+}
+
+void OrbbecWorkerPool::_worker_main(int index) {
+    current_worker = index;
+    while (true) {
+        // Bands of a run() come first: a thread is waiting for them.
+        std::shared_ptr<Job> job;
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex);
+            jobs_cv.wait(lock, [this, &job] {
+                job = _next_job();
+                return job != nullptr || pending_tasks.load() > 0;
+            });
+        }
+        if (job) {
+            _work_on(*job);
+            continue;
+        }
+        std::function<void()> task;
+        if (_take_task(index, task)) {
+            task();
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <string>
+
+/// Process-wide pool of worker threads, shared by all cameras of all capturers.
+/// It does two kinds of work:
+/// - run(): spread the work for a single frame (for example row bands of a depth image)
+///   over all cores, in stead of having one thread per camera do all the work.
+/// - submit(): asynchronous tasks, for example processing a frame of one camera. Every worker has its
+///   own task queue, and idle workers steal tasks from the others, so a camera that is slow (or
+///   has a burst of work) is helped by the cores other cameras do not need at the moment.
+class OrbbecWorkerPool {
+public:
+    /// Return the pool. It is created (and its threads started) on first use.
+    static OrbbecWorkerPool& instance();
+
+    /// Set the number of worker threads the pool will be created with (0: one less than the number of cores).
+    /// Returns false if the pool already exists with a different number of threads.
+    static bool set_thread_count(int nthread);
+
+    /// Call fn(0) upto fn(count-1), spread over the pool threads and the calling thread.
+    /// Returns when all calls have finished. Multiple threads may call run() at the same time,
+    /// including tasks running on the pool.
+    void run(int count, const std::function<void(int)>& fn);
+
+    /// Number of bands run_rows() splits nrow image rows into.
+    int row_band_count(int nrow) const;
+
+    /// Split image rows [first_row, end_row) into row_band_count() bands and call fn(band, band_first_row, band_end_row)
+    /// for every non-empty band, like run(). This is how all per-frame image work is spread over the pool.
+    void run_rows(int first_row, int end_row, const std::function<void(int, int, int)>& fn);
+
+    /// Run task asynchronously on a pool thread. A task submitted from a pool thread goes to the queue of
+    /// that thread, otherwise tasks are spread over the queues round-robin. Tasks should not block.
+    /// If the pool has no threads the task is run immediately by the caller.
+    void submit(std::function<void()> task);
+
+    /// Restrict all pool threads to the given CPUs (if not empty) and give them real-time priority
+    /// priority (if not 0). See orbbec_set_thread_policy(). Returns false and sets error on failure.
+    bool set_thread_policy(const std::vector<int>& cpus, int priority, std::string& error);
+
+    /// Number of threads that can work on a run() at the same time (including the caller).
+    int concurrency() const { return (int)workers.size() + 1; }
+
+private:
+    struct Job {
+        const std::function<void(int)>* fn = nullptr;
+        int count = 0;
+        std::atomic<int> next{0};   //<! Next index to hand out
+        std::atomic<int> done{0};   //<! Number of indices completed
+        std::mutex done_mutex;
+        std::condition_variable done_cv;
+    };
+    struct Worker {
+        std::thread* thread = nullptr;
+        std::mutex tasks_mutex;
+        std::deque<std::function<void()>> tasks;    //<! Owner pops from the back, thieves from the front
+    };
+
+    OrbbecWorkerPool(int nthread);
+    OrbbecWorkerPool(const OrbbecWorkerPool&);
+    OrbbecWorkerPool& operator=(const OrbbecWorkerPool&);
+
+    void _worker_main(int index);
+    /// Return a job that still has indices to hand out, or nullptr. Call with jobs_mutex held.
+    std::shared_ptr<Job> _next_job();
+    /// Work on job until it has no more indices to hand out.
+    void _work_on(Job& job);
+    /// Take a task from the queue of worker index, or steal one from another worker. Returns false if there is none.
+    bool _take_task(int index, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::mutex jobs_mutex;
+    std::condition_variable jobs_cv;    //<! Signals new jobs and new tasks
+    std::deque<std::shared_ptr<Job>> jobs;
+    std::atomic<int> pending_tasks{0};  //<! Number of submitted tasks not yet taken by a worker
+    std::atomic<unsigned> next_queue{0};    //<! Round-robin queue for tasks submitted from outside the pool
+};
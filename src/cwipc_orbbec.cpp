@@ -47,6 +47,12 @@ public:
             false,
             cwipc_activesource::is_metadata_requested("camera")
         );
+        this->m_grabber->metadata.want_normals = cwipc_activesource::is_metadata_requested("normals");
+    }
+
+    /// Deliver merged point clouds to callback in stead of through get().
+    bool set_pointcloud_callback(cwipc_orbbec_pointcloud_callback callback, void* user_data) {
+        return this->m_grabber->set_pointcloud_callback(callback, user_data);
     }
 
     virtual bool auxiliary_operation(const std::string op, const void* inbuf, size_t insize, void* outbuf, size_t outsize) override final {
@@ -69,6 +75,22 @@ public:
 
             return this->m_grabber->mapcolordepth(inint[0], inint[1], inint[2], outint);
 
+        } else if (op == "learn_background") {
+            // Optional input: number of frames (0 forgets the background). Without input processing.background_frames
+            // frames are learned, or 30 (BACKGROUND_FRAMES_DEFAULT) if that is 0.
+            int nframes = -1;
+            if (inbuf != nullptr) {
+                if (insize != sizeof(int)) return false;
+                nframes = *(int *)inbuf;
+                if (nframes < 0) return false;
+            }
+            return this->m_grabber->learn_background(nframes);
+
+        } else if (op == "get_dropped_frames") {
+            // Output: one uint64_t per camera, the number of frames it dropped because its processing queue was full.
+            if (outbuf == nullptr || outsize % sizeof(uint64_t) != 0) return false;
+            return this->m_grabber->get_dropped_frames((uint64_t *)outbuf, outsize / sizeof(uint64_t));
+
         } else {
             return false;
         }
@@ -151,6 +173,17 @@ cwipc_activesource* cwipc_orbbec_playback(const char* configFilename, char** err
     return NULL;
 }
 
+bool cwipc_orbbec_set_pointcloud_callback(cwipc_activesource* src, cwipc_orbbec_pointcloud_callback callback, void* user_data) {
+    if (auto capturer = dynamic_cast<cwipc_source_orbbec_impl*>(src)) {
+        return capturer->set_pointcloud_callback(callback, user_data);
+    }
+    if (auto capturer = dynamic_cast<cwipc_source_orbbec_playback_impl*>(src)) {
+        return capturer->set_pointcloud_callback(callback, user_data);
+    }
+    cwipc_log(CWIPC_LOG_LEVEL_ERROR, "cwipc_orbbec", "cwipc_orbbec_set_pointcloud_callback: not an orbbec capturer");
+    return false;
+}
+
 //
 // These static variables only exist to ensure the initializer is called, which registers our camera type.
 //
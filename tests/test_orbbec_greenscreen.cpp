@@ -0,0 +1,62 @@
+//
+// Check that the greenscreen mask (lookup table plus the exact test for cells marked
+// ORBBEC_GREENSCREEN_CHECK) gives the same answer as isNotGreen() for every color.
+//
+#include <cstdio>
+#include <vector>
+
+#include "OrbbecGreenscreen.hpp"
+#include "cwipc_util/internal/capturers.hpp"
+
+int main(int argc, char** argv) {
+    // One image per red value, with blue along the columns and green along the rows.
+    const int size = 256;
+    std::vector<uint8_t> color(4 * size * size);
+    std::vector<uint8_t> mask(size * size);
+    OrbbecPointKernelParams params;
+    params.width = size;
+    params.height = size;
+    params.color = color.data();
+    params.first_col = 0;
+    params.end_col = size;
+    size_t nwrong = 0;
+    size_t ncheck = 0;
+    for (int r = 0; r < 256; r++) {
+        for (int g = 0; g < 256; g++) {
+            for (int b = 0; b < 256; b++) {
+                uint8_t* bgra = color.data() + 4 * (g * size + b);
+                bgra[0] = b;
+                bgra[1] = g;
+                bgra[2] = r;
+                bgra[3] = 255;
+            }
+        }
+        orbbec_greenscreen_mask_rows(params, 0, size, mask.data());
+        for (int g = 0; g < 256; g++) {
+            for (int b = 0; b < 256; b++) {
+                uint8_t value = mask[g * size + b];
+                if (value == ORBBEC_GREENSCREEN_CHECK) {
+                    // The kernel calls isNotGreen() itself, so this is always right.
+                    ncheck++;
+                    continue;
+                }
+                cwipc_pcl_point pt;
+                pt.r = r;
+                pt.g = g;
+                pt.b = b;
+                pt.a = 0;
+                bool keep = isNotGreen(&pt);
+                bool unchanged = pt.r == r && pt.g == g && pt.b == b;
+                bool ok = value == ORBBEC_GREENSCREEN_KEEP ? (keep && unchanged) : !keep;
+                if (!ok) {
+                    if (nwrong < 10) {
+                        printf("color r=%d g=%d b=%d: mask %d but isNotGreen() %d%s\n", r, g, b, value, keep, unchanged ? "" : " (changed color)");
+                    }
+                    nwrong++;
+                }
+            }
+        }
+    }
+    printf("test_orbbec_greenscreen: %zu colors wrong, %.1f%% of colors need the exact test\n", nwrong, 100.0 * ncheck / (256.0 * 256.0 * 256.0));
+    return nwrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+//
+// Check that all point kernels this CPU supports produce bit-identical output,
+// for every filter combination, on a synthetic depth and color image.
+//
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "OrbbecPointKernels.hpp"
+#include "OrbbecGreenscreen.hpp"
+
+typedef std::vector<cwipc_pcl_point, Eigen::aligned_allocator<cwipc_pcl_point>> point_vector;
+
+// Odd sizes, so the SIMD kernels also have leftover pixels at the end of every row.
+static const int WIDTH = 643;
+static const int HEIGHT = 97;
+
+/// Run kernel over the image in two row bands (like the worker pool does). Returns the number of points.
+static size_t run_kernel(OrbbecPointKernel kernel, const OrbbecPointKernelParams& params, point_vector& points, std::vector<uint32_t>& pixels) {
+    size_t npixel = (size_t)params.width * params.height;
+    points.resize(npixel);
+    pixels.assign(npixel, 0);
+    // Points have padding that the kernels do not write, so give it a known value.
+    memset((void *)points.data(), 0, npixel * sizeof(cwipc_pcl_point));
+    int split = params.height / 3;
+    size_t count = kernel(params, 0, split, points.data(), pixels.data());
+    count += kernel(params, split, params.height, points.data() + count, pixels.data() + count);
+    return count;
+}
+
+int main(int argc, char** argv) {
+    size_t npixel = (size_t)WIDTH * HEIGHT;
+    std::mt19937 rng(42);
+    std::vector<uint16_t> depth(npixel);
+    std::vector<uint8_t> color(4 * npixel);
+    std::vector<float> ray_x(npixel);
+    std::vector<float> ray_y(npixel);
+    for (size_t i = 0; i < npixel; i++) {
+        int col = (int)(i % WIDTH);
+        int row = (int)(i / WIDTH);
+        // About a quarter of the pixels have no depth, the rest is between 0 and 5 meters.
+        depth[i] = (rng() % 4 == 0) ? 0 : (uint16_t)(rng() % 5000);
+        for (int c = 0; c < 4; c++) {
+            color[4*i + c] = (uint8_t)rng();
+        }
+        // And some pixels are clearly green.
+        if (rng() % 3 == 0) {
+            color[4*i + 1] = 200 + (uint8_t)(rng() % 56);
+            color[4*i + 0] = (uint8_t)(rng() % 80);
+            color[4*i + 2] = (uint8_t)(rng() % 80);
+        }
+        ray_x[i] = (col - WIDTH / 2) / 500.0f;
+        ray_y[i] = (row - HEIGHT / 2) / 500.0f;
+    }
+    // Camera 1.5m in front of the origin looking back at it, depth units in millimeters.
+    const float trafo[12] = {
+        -0.0405e-3f, -0.9969e-3f, -0.0665e-3f, 0.0985f,
+        -0.9812e-3f,  0.0523e-3f, -0.1852e-3f, 0.9854f,
+         0.1881e-3f,  0.0577e-3f, -0.9804e-3f, 1.4622f
+    };
+    std::vector<uint8_t> greenscreen_mask(npixel);
+
+    std::vector<const OrbbecPointKernelSet*> kernel_sets = orbbec_supported_point_kernels();
+    printf("test_orbbec_point_kernels: testing");
+    for (auto set : kernel_sets) {
+        printf(" %s", set->name);
+    }
+    printf("\n");
+    int failures = 0;
+    for (int filters = 0; filters < ORBBEC_POINT_FILTER_COMBINATIONS; filters++) {
+        OrbbecPointKernelParams params;
+        params.width = WIDTH;
+        params.height = HEIGHT;
+        params.depth = depth.data();
+        params.color = color.data();
+        params.ray_x = ray_x.data();
+        params.ray_y = ray_y.data();
+        params.first_col = (filters & 1) ? 0 : 37;
+        params.end_col = (filters & 1) ? WIDTH : WIDTH - 41;
+        params.depth_min = (filters & 1) ? 300 : 1;
+        params.depth_max = (filters & 2) ? 4000 : 65535;
+        memcpy(params.trafo, trafo, sizeof(trafo));
+        params.do_height_filtering = (filters & ORBBEC_POINT_FILTER_HEIGHT) != 0;
+        params.height_min = 0.2f;
+        params.height_max = 1.5f;
+        params.do_radius_filtering = (filters & ORBBEC_POINT_FILTER_RADIUS) != 0;
+        params.radius_squared = 0.36f;
+        params.do_greenscreen_removal = (filters & ORBBEC_POINT_FILTER_GREENSCREEN) != 0;
+        params.greenscreen_mask = greenscreen_mask.data();
+        params.tile = 2;
+        orbbec_greenscreen_mask_rows(params, 0, HEIGHT, greenscreen_mask.data());
+
+        point_vector reference_points;
+        std::vector<uint32_t> reference_pixels;
+        const OrbbecPointKernelSet* reference = kernel_sets.back();
+        size_t reference_count = run_kernel(reference->select(params), params, reference_points, reference_pixels);
+        if (reference_count == 0 || reference_count == npixel) {
+            printf("filters %d: %s kernel produced %zu points, test data is useless\n", filters, reference->name, reference_count);
+            failures++;
+        }
+        for (auto set : kernel_sets) {
+            if (set == reference) continue;
+            point_vector points;
+            std::vector<uint32_t> pixels;
+            size_t count = run_kernel(set->select(params), params, points, pixels);
+            bool ok = count == reference_count &&
+                memcmp(points.data(), reference_points.data(), count * sizeof(cwipc_pcl_point)) == 0 &&
+                memcmp(pixels.data(), reference_pixels.data(), count * sizeof(uint32_t)) == 0;
+            if (!ok) {
+                printf("filters %d: %s kernel differs from %s kernel (%zu points vs %zu)\n", filters, set->name, reference->name, count, reference_count);
+                failures++;
+            }
+        }
+    }
+    if (failures == 0) {
+        printf("test_orbbec_point_kernels: all kernels identical\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+//
+// Stress test for OrbbecTripleBuffer: one producer publishing as fast as it can, one consumer
+// taking as fast as it can. Every published value must come back exactly once (either taken by
+// the consumer or returned to the producer as replaced), and the consumer must only ever see
+// values newer than the previous one it took.
+//
+#include <atomic>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+#include "OrbbecTripleBuffer.hpp"
+
+static const int COUNT = 1000000;
+
+int main(int argc, char** argv) {
+    OrbbecTripleBuffer<int*> buffer;
+    std::vector<int> values(COUNT);
+    // Number of times each value came back, to the consumer or to the producer.
+    std::vector<std::atomic<int>> returned(COUNT);
+    for (int i = 0; i < COUNT; i++) {
+        values[i] = i;
+        returned[i] = 0;
+    }
+    std::atomic<bool> producer_done{false};
+    size_t ntaken = 0;
+    size_t nreplaced = 0;
+    size_t nout_of_order = 0;
+
+    std::thread producer([&] {
+        for (int i = 0; i < COUNT; i++) {
+            int* replaced = buffer.publish(&values[i]);
+            if (replaced != nullptr) {
+                returned[*replaced]++;
+                nreplaced++;
+            }
+        }
+        producer_done = true;
+    });
+    std::thread consumer([&] {
+        int last = -1;
+        while (true) {
+            // Read the flag before taking, so we cannot miss the final value.
+            bool done = producer_done;
+            int* taken = buffer.take();
+            if (taken != nullptr) {
+                if (*taken <= last) nout_of_order++;
+                last = *taken;
+                returned[*taken]++;
+                ntaken++;
+            } else if (done) {
+                break;
+            }
+        }
+    });
+    producer.join();
+    consumer.join();
+
+    int failures = 0;
+    size_t nlost = 0;
+    size_t nduplicate = 0;
+    for (int i = 0; i < COUNT; i++) {
+        if (returned[i] == 0) nlost++;
+        if (returned[i] > 1) nduplicate++;
+    }
+    if (nlost != 0 || nduplicate != 0) {
+        printf("FAIL: %zu values lost, %zu values returned more than once\n", nlost, nduplicate);
+        failures++;
+    }
+    if (nout_of_order != 0) {
+        printf("FAIL: consumer took %zu values older than the previous one\n", nout_of_order);
+        failures++;
+    }
+    if (returned[COUNT-1] != 1 || ntaken == 0) {
+        printf("FAIL: consumer did not get the last value\n");
+        failures++;
+    }
+    if (buffer.available() || buffer.take() != nullptr) {
+        printf("FAIL: buffer not empty at the end\n");
+        failures++;
+    }
+    printf("test_orbbec_triple_buffer: %zu taken, %zu replaced\n", ntaken, nreplaced);
+    if (failures == 0) {
+        printf("test_orbbec_triple_buffer: all tests passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+//
+// Tests for OrbbecVoxelGrid (per-camera downsampling) and OrbbecVoxelDeduplicator (merging).
+//
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+#include "OrbbecVoxelGrid.hpp"
+
+static int failures = 0;
+
+static void check(bool ok, const char* what) {
+    if (!ok) {
+        printf("FAIL: %s\n", what);
+        failures++;
+    }
+}
+
+static cwipc_pcl_point make_point(float x, float y, float z, uint8_t r=0, uint8_t g=0, uint8_t b=0, uint8_t tile=1) {
+    cwipc_pcl_point pt;
+    pt.x = x;
+    pt.y = y;
+    pt.z = z;
+    pt.r = r;
+    pt.g = g;
+    pt.b = b;
+    pt.a = tile;
+    return pt;
+}
+
+static void test_voxel_grid() {
+    std::vector<cwipc_pcl_point> points = {
+        make_point(0.101f, 0.2f, 0.3f, 10, 20, 30, 1),
+        make_point(0.109f, 0.2f, 0.3f, 30, 40, 50, 2),     // same 1cm voxel as the first point
+        make_point(-0.101f, 0.2f, 0.3f, 100, 100, 100, 1), // different voxel
+    };
+    OrbbecVoxelGrid grid;
+    grid.begin(0.01f, points.size());
+    grid.add(points.data(), nullptr, points.size());
+    check(grid.size() == 2, "grid: two occupied voxels");
+    check(grid.out_of_range() == 0, "grid: no points out of range");
+    cwipc_pcl_pointcloud pc = new_cwipc_pcl_pointcloud();
+    grid.store(pc);
+    check(pc->size() == 2, "grid: one point per voxel");
+    if (pc->size() == 2) {
+        const cwipc_pcl_point& centroid = pc->points[0];
+        check(std::fabs(centroid.x - 0.105f) < 1e-6f, "grid: centroid of first voxel");
+        check(centroid.r == 20 && centroid.g == 30 && centroid.b == 40, "grid: average color of first voxel");
+        check(centroid.a == 3, "grid: tile mask is or of points");
+        check(pc->points[1].x == -0.101f && pc->points[1].r == 100, "grid: second voxel keeps its single point");
+    }
+
+    // With 0.5mm voxels keys cover about +/- 524m. A point at 600m used to wrap around onto the
+    // voxel at 600 - 2^21 * 0.0005 = -448.576m.
+    std::vector<cwipc_pcl_point> far_points = {
+        make_point(-448.576f, 0.0f, 0.0f, 1, 1, 1),
+        make_point(600.0f, 0.0f, 0.0f, 200, 200, 200),
+        make_point(NAN, 0.0f, 0.0f, 200, 200, 200),
+    };
+    grid.begin(0.0005f, far_points.size());
+    grid.add(far_points.data(), nullptr, far_points.size());
+    check(grid.size() == 1, "grid: points out of range do not occupy a voxel");
+    check(grid.out_of_range() == 2, "grid: points out of range are counted");
+    cwipc_pcl_pointcloud far_pc = new_cwipc_pcl_pointcloud();
+    grid.store(far_pc);
+    check(far_pc->size() == 1 && far_pc->points[0].r == 1, "grid: far point is not merged into another voxel");
+}
+
+static void test_deduplicator() {
+    // Two cameras looking at the plane z=0 from opposite sides. Camera 0 (2m away) sees x in [-0.5, 0.5),
+    // camera 1 (3m away) sees x in [0, 1). Where they overlap camera 0 is closer, so it wins.
+    const float voxel_size = 0.01f;
+    const float position0[3] = { 0, 0, -2 };
+    const float position1[3] = { 0, 0, 3 };
+    std::vector<cwipc_pcl_point> points0;
+    std::vector<cwipc_pcl_point> points1;
+    for (int i = -50; i < 50; i++) {
+        points0.push_back(make_point((i + 0.5f) * voxel_size, 0.0f, 0.001f, 0, 0, 0, 1));
+    }
+    for (int i = 0; i < 100; i++) {
+        points1.push_back(make_point((i + 0.5f) * voxel_size, 0.0f, 0.002f, 0, 0, 0, 2));
+    }
+    // And a point too far away to get a voxel, which must be kept.
+    points1.push_back(make_point(1e9f, 0.0f, 0.0f));
+    OrbbecVoxelDeduplicator deduplicator;
+    deduplicator.begin(voxel_size, points0.size() + points1.size());
+    deduplicator.add(0, position0, points0.data(), points0.size());
+    deduplicator.add(1, position1, points1.data(), points1.size());
+    check(deduplicator.out_of_range() == 1, "dedup: point out of range is counted");
+    size_t kept0 = 0;
+    for (size_t i = 0; i < points0.size(); i++) {
+        if (deduplicator.keep(0, i)) kept0++;
+    }
+    check(kept0 == points0.size(), "dedup: closer camera keeps all its points");
+    bool overlap_dropped = true;
+    bool rest_kept = true;
+    for (size_t i = 0; i < 100; i++) {
+        bool keep = deduplicator.keep(1, i);
+        if (points1[i].x < 0.5f && keep) overlap_dropped = false;
+        if (points1[i].x > 0.5f && !keep) rest_kept = false;
+    }
+    check(overlap_dropped, "dedup: further camera loses the overlapping region");
+    check(rest_kept, "dedup: further camera keeps the region only it sees");
+    check(deduplicator.keep(1, 100), "dedup: point out of range is kept");
+}
+
+int main(int argc, char** argv) {
+    test_voxel_grid();
+    test_deduplicator();
+    if (failures == 0) {
+        printf("test_orbbec_voxel_grid: all tests passed\n");
+    }
+    return failures == 0 ? 0 : 1;
+}